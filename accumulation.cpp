@@ -0,0 +1,250 @@
+#include "accumulation.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+constexpr std::int64_t kIntMin = std::numeric_limits<int>::min();
+constexpr std::int64_t kIntMax = std::numeric_limits<int>::max();
+constexpr std::int64_t kInt64Max = std::numeric_limits<std::int64_t>::max();
+
+// A is split as A = hi * 2^kSplitBits + lo when int64 sums could overflow:
+// lo in [0, 2^kSplitBits) and hi in [-2^15, 2^15), so every sum of either
+// half times B stays below n * 2^47
+constexpr int kSplitBits = 16;
+constexpr std::uint64_t kSplitMagnitude = std::uint64_t(1) << kSplitBits;
+
+// rows handed to one pool task by the diagonal sums
+constexpr std::size_t kDiagonalTaskRows = 4096;
+
+// an exact value as the int policy P makes it; out-of-range values set
+// overflowed
+template <Accumulation P, typename Wide>
+int narrow(Wide value, bool &overflowed) {
+    if (value < kIntMin || value > kIntMax) {
+        overflowed = true;
+        if (P == Accumulation::saturate) {
+            return value < 0 ? static_cast<int>(kIntMin) : static_cast<int>(kIntMax);
+        }
+    }
+    return static_cast<int>(static_cast<std::uint32_t>(value));
+}
+
+// a checked result's verdict goes to *overflow, or is thrown without one
+void report_overflow(bool overflowed, bool *overflow, const char *what) {
+    if (overflow) {
+        *overflow = overflowed;
+    } else if (overflowed) {
+        throw std::overflow_error(std::string("Integer overflow in ") + what);
+    }
+}
+
+// largest |value| in m, as a 64-bit magnitude (|INT_MIN| included)
+std::uint64_t max_magnitude(const Matrix &m) {
+    const std::size_t n = m.size();
+    std::vector<std::uint64_t> per_row(n, 0);
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const int *row = m.row(i);
+        std::uint64_t most = 0;
+        for (std::size_t j = 0; j < n; ++j) {
+            const std::int64_t v = row[j];
+            most = std::max(most, static_cast<std::uint64_t>(v < 0 ? -v : v));
+        }
+        per_row[i] = most;
+    }, std::max<std::size_t>(1, kElementwiseTaskInts / std::max<std::size_t>(1, m.stride())));
+    return n == 0 ? 0 : *std::max_element(per_row.begin(), per_row.end());
+}
+
+// A * B in int64 when n * max|a| * max|b| fits; otherwise A is split into
+// halves whose products do fit, and out(i, j) gets hi(i, j) * 2^16 +
+// lo(i, j) as exact wider values. throws std::overflow_error if even the
+// halves' sums could overflow, which needs n of 2^16 or more.
+template <typename Emit>
+void exact_product(const Matrix &a, const Matrix &b, std::uint64_t ma, std::uint64_t mb, Emit emit) {
+    const std::size_t n = a.size();
+    const std::size_t grain = std::max<std::size_t>(1, kElementwiseTaskInts / std::max<std::size_t>(1, a.stride()));
+    // gemm reads physical columns, so pending column swaps are applied to a
+    // snapshot first
+    Matrix a_dense = a, b_dense = b;
+    a_dense.materialize();
+    b_dense.materialize();
+
+    const std::uint64_t limit = static_cast<std::uint64_t>(kInt64Max);
+    if (ma <= limit / mb / n) {
+        BasicMatrix<std::int64_t> wide(n);
+        gemm_widened(std::as_const(a_dense).view(), std::as_const(b_dense).view(), wide.view(), n, n, n);
+        default_thread_pool().parallel_for(n, [&](std::size_t i) {
+            emit(i, std::as_const(wide).row(i));
+        }, grain);
+        return;
+    }
+    if (kSplitMagnitude > limit / mb / n) {
+        throw std::overflow_error("Matrix too large for exact integer multiplication");
+    }
+
+    Matrix hi(n), lo(n);
+    const MatrixView hi_out = hi.view(), lo_out = lo.view();
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const int *src = std::as_const(a_dense).row(i);
+        int *h = hi_out.row(i);
+        int *l = lo_out.row(i);
+        for (std::size_t j = 0; j < n; ++j) {
+            const std::int64_t v = src[j];
+            const std::int64_t low = v & static_cast<std::int64_t>(kSplitMagnitude - 1);
+            l[j] = static_cast<int>(low);
+            h[j] = static_cast<int>((v - low) / static_cast<std::int64_t>(kSplitMagnitude));
+        }
+    }, grain);
+    a_dense = Matrix(0);
+
+    BasicMatrix<std::int64_t> wide_hi(n), wide_lo(n);
+    gemm_widened(std::as_const(hi).view(), std::as_const(b_dense).view(), wide_hi.view(), n, n, n);
+    gemm_widened(std::as_const(lo).view(), std::as_const(b_dense).view(), wide_lo.view(), n, n, n);
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const std::int64_t *h = std::as_const(wide_hi).row(i);
+        const std::int64_t *l = std::as_const(wide_lo).row(i);
+        std::vector<__int128> row(n);
+        for (std::size_t j = 0; j < n; ++j) {
+            row[j] = static_cast<__int128>(h[j]) * static_cast<__int128>(kSplitMagnitude) + l[j];
+        }
+        emit(i, row.data());
+    }, grain);
+}
+
+// exact sum of row(i)[column(i)] over all rows, split into row chunks on
+// the pool
+template <typename Column>
+std::int64_t wide_diagonal(const Matrix &m, Column column) {
+    const std::size_t n = m.size();
+    const std::size_t chunks = (n + kDiagonalTaskRows - 1) / kDiagonalTaskRows;
+    std::vector<std::int64_t> partial(chunks, 0);
+    default_thread_pool().parallel_for(chunks, [&](std::size_t chunk) {
+        const std::size_t end = std::min(n, (chunk + 1) * kDiagonalTaskRows);
+        std::int64_t sum = 0;
+        for (std::size_t i = chunk * kDiagonalTaskRows; i < end; ++i) {
+            sum += m.row(i)[m.col_index(column(i))];
+        }
+        partial[chunk] = sum;
+    }, 1);
+
+    std::int64_t sum = 0;
+    for (std::int64_t value : partial) {
+        sum += value;
+    }
+    return sum;
+}
+
+template <Accumulation P>
+accumulation_t<P> finish_sum(std::int64_t sum, bool *overflow) {
+    if constexpr (P == Accumulation::widen) {
+        return sum;
+    } else {
+        bool overflowed = false;
+        const int value = narrow<P>(sum, overflowed);
+        if (P == Accumulation::checked) {
+            report_overflow(overflowed, overflow, "diagonal sum");
+        }
+        return value;
+    }
+}
+
+} // namespace
+
+template <Accumulation P>
+BasicMatrix<accumulation_t<P>> multiply(const Matrix &a, const Matrix &b, bool *overflow) {
+    const std::size_t n = a.size();
+    if (n != b.size()) {
+        throw std::runtime_error("Matrix dimensions incompatible for multiplication");
+    }
+    if (P == Accumulation::checked && overflow) {
+        *overflow = false;
+    }
+
+    // every sum is bounded by n * max|a| * max|b|; when that fits in an int
+    // nothing can overflow and the int kernels give the exact answer
+    bool exact_in_int = P == Accumulation::wrap || n == 0;
+    std::uint64_t ma = 0, mb = 0;
+    if (!exact_in_int) {
+        const std::uint64_t bound = static_cast<std::uint64_t>(kIntMax) / n;
+        ma = max_magnitude(a);
+        mb = max_magnitude(b);
+        exact_in_int = ma == 0 || mb == 0 || (ma <= bound && mb <= bound / ma);
+    }
+    if (exact_in_int) {
+        Matrix product = a * b;
+        if constexpr (P == Accumulation::widen) {
+            BasicMatrix<std::int64_t> wide(n);
+            const BasicMatrixView<std::int64_t> out = wide.view();
+            default_thread_pool().parallel_for(n, [&](std::size_t i) {
+                const int *src = product.row(i);
+                std::copy(src, src + n, out.row(i));
+            }, std::max<std::size_t>(1, kElementwiseTaskInts / std::max<std::size_t>(1, wide.stride())));
+            return wide;
+        } else {
+            return product;
+        }
+    }
+
+    BasicMatrix<accumulation_t<P>> result(n);
+    const BasicMatrixView<accumulation_t<P>> out = result.view();
+    std::atomic<bool> any{false};
+    exact_product(a, b, ma, mb, [&](std::size_t i, const auto *src) {
+        accumulation_t<P> *dst = out.row(i);
+        bool overflowed = false;
+        for (std::size_t j = 0; j < n; ++j) {
+            if constexpr (P == Accumulation::widen) {
+                if (src[j] != static_cast<std::int64_t>(src[j])) {
+                    overflowed = true;
+                }
+                dst[j] = static_cast<std::int64_t>(src[j]);
+            } else {
+                dst[j] = narrow<P>(src[j], overflowed);
+            }
+        }
+        if (overflowed) {
+            any.store(true, std::memory_order_relaxed);
+        }
+    });
+    if (P == Accumulation::widen && any.load()) {
+        throw std::overflow_error("Integer overflow in widened matrix multiplication");
+    }
+    if (P == Accumulation::checked) {
+        report_overflow(any.load(), overflow, "matrix multiplication");
+    }
+    return result;
+}
+
+template <Accumulation P>
+accumulation_t<P> sum_diagonal_major(const Matrix &m, bool *overflow) {
+    return finish_sum<P>(wide_diagonal(m, [](std::size_t i) { return i; }), overflow);
+}
+
+template <Accumulation P>
+accumulation_t<P> sum_diagonal_minor(const Matrix &m, bool *overflow) {
+    const std::size_t last = m.size() - 1;
+    return finish_sum<P>(wide_diagonal(m, [last](std::size_t i) { return last - i; }), overflow);
+}
+
+template BasicMatrix<int> multiply<Accumulation::wrap>(const Matrix &, const Matrix &, bool *);
+template BasicMatrix<std::int64_t> multiply<Accumulation::widen>(const Matrix &, const Matrix &, bool *);
+template BasicMatrix<int> multiply<Accumulation::saturate>(const Matrix &, const Matrix &, bool *);
+template BasicMatrix<int> multiply<Accumulation::checked>(const Matrix &, const Matrix &, bool *);
+
+template int sum_diagonal_major<Accumulation::wrap>(const Matrix &, bool *);
+template std::int64_t sum_diagonal_major<Accumulation::widen>(const Matrix &, bool *);
+template int sum_diagonal_major<Accumulation::saturate>(const Matrix &, bool *);
+template int sum_diagonal_major<Accumulation::checked>(const Matrix &, bool *);
+
+template int sum_diagonal_minor<Accumulation::wrap>(const Matrix &, bool *);
+template std::int64_t sum_diagonal_minor<Accumulation::widen>(const Matrix &, bool *);
+template int sum_diagonal_minor<Accumulation::saturate>(const Matrix &, bool *);
+template int sum_diagonal_minor<Accumulation::checked>(const Matrix &, bool *);
@@ -0,0 +1,46 @@
+#ifndef __ACCUMULATION_HPP__
+#define __ACCUMULATION_HPP__
+
+#include <cstdint>
+#include <type_traits>
+
+#include "matrix.hpp"
+
+// how int products and sums treat results outside int's range
+enum class Accumulation {
+    // modulo 2^32, which is what operator* and the Matrix members do
+    wrap,
+    // the exact result, as int64
+    widen,
+    // the exact result clamped to [INT_MIN, INT_MAX]
+    saturate,
+    // wrapped like `wrap`, and reported if anything did not fit
+    checked,
+};
+
+// result element type of a policy: int64 for widen, int for the others
+template <Accumulation P>
+using accumulation_t = std::conditional_t<P == Accumulation::widen, std::int64_t, int>;
+
+// A * B under policy P. every policy but wrap needs the exact sums: when
+// the operands' largest magnitudes prove no sum can leave int's range, the
+// int kernels are used as they are; otherwise the product is accumulated
+// in int64 by gemm_widened() and narrowed in one pass. when even int64
+// sums could overflow (near-INT_MIN operands), A is split into 16-bit
+// halves multiplied separately and recombined exactly; widen then throws
+// std::overflow_error for an element outside int64. for checked,
+// *overflow is set to whether any element did not fit; with a null
+// overflow, checked throws std::overflow_error instead. the other policies
+// ignore overflow. throws std::runtime_error like operator* if the sizes
+// differ.
+template <Accumulation P>
+BasicMatrix<accumulation_t<P>> multiply(const Matrix &a, const Matrix &b, bool *overflow = nullptr);
+
+// the diagonal sums of m under policy P, accumulated in int64 and then
+// narrowed (overflow as for multiply())
+template <Accumulation P>
+accumulation_t<P> sum_diagonal_major(const Matrix &m, bool *overflow = nullptr);
+template <Accumulation P>
+accumulation_t<P> sum_diagonal_minor(const Matrix &m, bool *overflow = nullptr);
+
+#endif // __ACCUMULATION_HPP__
@@ -0,0 +1,139 @@
+#include "adaptive_matrix.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+AdaptiveMatrix::AdaptiveMatrix(const Matrix &m) : AdaptiveMatrix(m, sample_density(m)) {}
+
+AdaptiveMatrix::AdaptiveMatrix(const Matrix &m, const DensityStats &stats)
+    : format_(choose_format(stats)), stats_(stats) {
+    if (stats.n != m.size()) {
+        throw std::runtime_error("Density counts are for a " + std::to_string(stats.n) + " x " +
+                                 std::to_string(stats.n) + " matrix, not " + std::to_string(m.size()) + " x " +
+                                 std::to_string(m.size()));
+    }
+    switch (format_) {
+    case StorageFormat::dense:
+        dense_ = m;
+        break;
+    case StorageFormat::csr:
+        csr_ = SparseMatrix(m);
+        break;
+    case StorageFormat::blocked:
+        blocked_ = BlockSparseMatrix(m);
+        break;
+    }
+}
+
+AdaptiveMatrix::AdaptiveMatrix(const SparseMatrix &m) : stats_(m.density()) {
+    format_ = choose_format(stats_);
+    switch (format_) {
+    case StorageFormat::dense:
+        dense_ = m.to_dense();
+        break;
+    case StorageFormat::csr:
+        csr_ = m.to_layout(SparseLayout::csr);
+        break;
+    case StorageFormat::blocked:
+        blocked_ = BlockSparseMatrix(m);
+        break;
+    }
+}
+
+AdaptiveMatrix::AdaptiveMatrix(Matrix m, StorageFormat format) : format_(format), dense_(std::move(m)) {
+    stats_.n = dense_.size();
+    stats_.nonzeros = stats_.n * stats_.n;
+    stats_.blocks = (stats_.n + DensityStats::kBlock - 1) / DensityStats::kBlock;
+    stats_.blocks *= stats_.blocks;
+}
+
+Matrix AdaptiveMatrix::to_dense() const {
+    switch (format_) {
+    case StorageFormat::csr:
+        return csr_.to_dense();
+    case StorageFormat::blocked:
+        return blocked_.to_dense();
+    default:
+        return dense_;
+    }
+}
+
+int AdaptiveMatrix::get_value(std::size_t i, std::size_t j) const {
+    switch (format_) {
+    case StorageFormat::csr:
+        return csr_.get_value(i, j);
+    case StorageFormat::blocked:
+        return blocked_.get_value(i, j);
+    default:
+        return dense_.get_value(i, j);
+    }
+}
+
+std::uint64_t AdaptiveMatrix::max_magnitude() const {
+    auto largest = [](const int *first, const int *last, std::uint64_t most) {
+        for (; first != last; ++first) {
+            const std::int64_t v = *first;
+            most = std::max(most, static_cast<std::uint64_t>(v < 0 ? -v : v));
+        }
+        return most;
+    };
+    switch (format_) {
+    case StorageFormat::csr: {
+        const std::vector<int> &values = csr_.values();
+        return largest(values.data(), values.data() + values.size(), 0);
+    }
+    case StorageFormat::blocked: {
+        const std::size_t count = blocked_.blocks() * BlockSparseMatrix::kBlock * BlockSparseMatrix::kBlock;
+        return largest(blocked_.panel(0), blocked_.panel(0) + count, 0);
+    }
+    default: {
+        std::uint64_t most = 0;
+        for (std::size_t i = 0; i < dense_.size(); ++i) {
+            const int *row = dense_.row(i);
+            most = largest(row, row + dense_.size(), most);
+        }
+        return most;
+    }
+    }
+}
+
+AdaptiveMatrix operator*(const AdaptiveMatrix &a, const AdaptiveMatrix &b) {
+    if (a.size() != b.size()) {
+        throw std::runtime_error("Matrix dimensions incompatible for multiplication");
+    }
+    const StorageFormat fa = a.format();
+    const StorageFormat fb = b.format();
+    auto as_csr = [](const AdaptiveMatrix &m) {
+        return m.format() == StorageFormat::blocked ? m.blocked().to_sparse() : m.csr();
+    };
+
+    if (fb == StorageFormat::dense) {
+        switch (fa) {
+        case StorageFormat::dense:
+            return AdaptiveMatrix(a.dense() * b.dense(), StorageFormat::dense);
+        case StorageFormat::csr:
+            return AdaptiveMatrix(a.csr() * b.dense(), StorageFormat::dense);
+        case StorageFormat::blocked:
+            return AdaptiveMatrix(a.blocked() * b.dense(), StorageFormat::dense);
+        }
+    }
+    if (fa == StorageFormat::dense) {
+        return AdaptiveMatrix(a.dense() * as_csr(b), StorageFormat::dense);
+    }
+    return AdaptiveMatrix(as_csr(a) * as_csr(b));
+}
+
+bool product_fits_int(const AdaptiveMatrix &a, const AdaptiveMatrix &b) {
+    const std::size_t n = a.size();
+    const std::uint64_t ma = a.max_magnitude();
+    const std::uint64_t mb = b.max_magnitude();
+    if (n == 0 || ma == 0 || mb == 0) {
+        return true;
+    }
+    const std::uint64_t bound = static_cast<std::uint64_t>(std::numeric_limits<int>::max()) / n;
+    return ma <= bound && mb <= bound / ma;
+}
@@ -0,0 +1,72 @@
+#ifndef __ADAPTIVE_MATRIX_HPP__
+#define __ADAPTIVE_MATRIX_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "density.hpp"
+#include "matrix.hpp"
+#include "sparse_matrix.hpp"
+
+// a square int matrix kept in whichever StorageFormat choose_format() picks
+// for its density, so callers never pick one by hand. the counts come from
+// the loader (AsyncMatrixLoad::a_stats(), load_matrices_parallel()) when
+// there are any, and from sample_density() otherwise. only the chosen
+// representation is held; dense() / csr() / blocked() give it to kernels.
+class AdaptiveMatrix {
+public:
+    // counts from sample_density()
+    explicit AdaptiveMatrix(const Matrix &m);
+    // counts gathered elsewhere, e.g. while m was parsed. throws
+    // std::runtime_error if they describe a matrix of another size.
+    AdaptiveMatrix(const Matrix &m, const DensityStats &stats);
+    // a sparse matrix, kept sparse or densified as its exact counts say
+    explicit AdaptiveMatrix(const SparseMatrix &m);
+
+    StorageFormat format() const { return format_; }
+    const DensityStats &stats() const { return stats_; }
+    std::size_t size() const { return stats_.n; }
+    int get_size() const { return static_cast<int>(size()); }
+
+    Matrix to_dense() const;
+    // bounds-checked like Matrix (std::out_of_range)
+    int get_value(std::size_t i, std::size_t j) const;
+    // largest |element|, as a 64-bit magnitude (|INT_MIN| included)
+    std::uint64_t max_magnitude() const;
+
+    // the representation in use; the others are empty
+    const Matrix &dense() const { return dense_; }
+    const SparseMatrix &csr() const { return csr_; }
+    const BlockSparseMatrix &blocked() const { return blocked_; }
+
+private:
+    // a dense product, stored as it is
+    AdaptiveMatrix(Matrix m, StorageFormat format);
+
+    friend AdaptiveMatrix operator*(const AdaptiveMatrix &a, const AdaptiveMatrix &b);
+
+    StorageFormat format_ = StorageFormat::dense;
+    DensityStats stats_;
+    Matrix dense_{0};
+    SparseMatrix csr_;
+    BlockSparseMatrix blocked_;
+};
+
+// A * B with the kernel for the pair of formats:
+//   dense   * dense       gemm (Matrix's operator*)
+//   csr     * dense       sparse rows streamed over B
+//   blocked * dense       one gemm() per tile row
+//   dense   * sparse      rows of the sparse factor scattered
+//   sparse  * sparse      Gustavson's row-by-row product
+// blocked operands are converted to CSR where only the sparse kernels
+// apply. a product with a dense factor is dense; a sparse-only one gets
+// the format its own counts call for. throws std::runtime_error like
+// operator* if the sizes differ.
+AdaptiveMatrix operator*(const AdaptiveMatrix &a, const AdaptiveMatrix &b);
+
+// true when no element of A * B can leave int's range, because N * max|A| *
+// max|B| fits in an int. the sparse kernels wrap without checking, so a
+// caller that has to report overflow checks this before using them.
+bool product_fits_int(const AdaptiveMatrix &a, const AdaptiveMatrix &b);
+
+#endif // __ADAPTIVE_MATRIX_HPP__
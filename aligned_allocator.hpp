@@ -0,0 +1,44 @@
+#ifndef __ALIGNED_ALLOCATOR_HPP__
+#define __ALIGNED_ALLOCATOR_HPP__
+
+#include <cstddef>
+#include <new>
+
+// size of a cache line on every target we care about
+constexpr std::size_t kCacheLine = 64;
+
+// minimal allocator that hands out storage aligned to Align bytes, so that
+// std::vector can be used for buffers that SIMD and cache-blocked code walk
+template <typename T, std::size_t Align = kCacheLine>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Align>;
+    };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Align> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+    }
+
+    void deallocate(T *p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Align));
+    }
+};
+
+template <typename T, typename U, std::size_t Align>
+bool operator==(const AlignedAllocator<T, Align> &, const AlignedAllocator<U, Align> &) noexcept {
+    return true;
+}
+
+template <typename T, typename U, std::size_t Align>
+bool operator!=(const AlignedAllocator<T, Align> &, const AlignedAllocator<U, Align> &) noexcept {
+    return false;
+}
+
+#endif // __ALIGNED_ALLOCATOR_HPP__
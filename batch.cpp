@@ -0,0 +1,142 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <streambuf>
+#include <system_error>
+
+#include "matrix_io.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+// records in flight per worker; bounds the text held back for ordering
+constexpr std::size_t kRecordsPerWorker = 8;
+
+// stream buffer that appends to a string, so a record's text lands in a
+// buffer whose capacity carries over from earlier records
+class StringAppender : public std::streambuf {
+public:
+    explicit StringAppender(std::string &text) : text_(text) {}
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            text_.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        text_.append(s, static_cast<std::size_t>(n));
+        return n;
+    }
+
+private:
+    std::string &text_;
+};
+
+struct LoadedInput {
+    std::vector<MatrixPair> records;
+    std::string error;
+};
+
+struct RecordText {
+    std::string out;
+    std::string err;
+};
+
+// the inputs with each directory replaced by the regular files directly in
+// it, sorted. a directory that cannot be listed stays as it is, so loading
+// it reports the error in its place.
+std::vector<std::string> expand_directories(const std::vector<std::string> &inputs) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    for (const std::string &input : inputs) {
+        std::error_code ec;
+        if (!fs::is_directory(input, ec)) {
+            files.push_back(input);
+            continue;
+        }
+        std::vector<std::string> listed;
+        for (fs::directory_iterator it(input, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->is_regular_file(ec)) {
+                listed.push_back(it->path().string());
+            }
+        }
+        if (ec) {
+            files.push_back(input);
+            continue;
+        }
+        std::sort(listed.begin(), listed.end());
+        files.insert(files.end(), listed.begin(), listed.end());
+    }
+    return files;
+}
+
+} // namespace
+
+std::size_t run_batch(const std::vector<std::string> &inputs, const BatchFn &fn, std::ostream &out,
+                      std::ostream &err) {
+    ThreadPool &pool = default_thread_pool();
+    const std::vector<std::string> files = expand_directories(inputs);
+
+    std::vector<LoadedInput> loaded(files.size());
+    pool.parallel_for(files.size(), [&](std::size_t f) {
+        try {
+            loaded[f].records = load_matrix_records(files[f]);
+        } catch (const std::runtime_error &e) {
+            loaded[f].error = e.what();
+        }
+    }, 1);
+
+    // (input, record) in input order; record == npos marks a failed input
+    struct Job {
+        std::size_t input;
+        std::size_t record;
+    };
+    std::vector<Job> jobs;
+    std::size_t failed = 0;
+    for (std::size_t f = 0; f < files.size(); ++f) {
+        if (!loaded[f].error.empty()) {
+            jobs.push_back({f, std::string::npos});
+            ++failed;
+        }
+        for (std::size_t r = 0; r < loaded[f].records.size(); ++r) {
+            jobs.push_back({f, r});
+        }
+    }
+
+    const std::size_t window = std::max<std::size_t>(1, pool.size() * kRecordsPerWorker);
+    std::vector<RecordText> texts(std::min(window, jobs.size()));
+    for (std::size_t first = 0; first < jobs.size(); first += window) {
+        const std::size_t count = std::min(window, jobs.size() - first);
+        pool.parallel_for(count, [&](std::size_t k) {
+            const Job &job = jobs[first + k];
+            RecordText &text = texts[k];
+            text.out.clear();
+            text.err.clear();
+            StringAppender out_buf(text.out), err_buf(text.err);
+            std::ostream record_out(&out_buf), record_err(&err_buf);
+            const LoadedInput &input = loaded[job.input];
+            if (job.record == std::string::npos) {
+                record_err << "Error: " << input.error << "\n"
+                           << "Error loading matrices from file: " << files[job.input] << "\n";
+                return;
+            }
+            const MatrixPair &pair = input.records[job.record];
+            fn(files[job.input], job.record, pair.a, pair.b, record_out, record_err);
+        }, 1);
+
+        for (std::size_t k = 0; k < count; ++k) {
+            if (!texts[k].err.empty()) {
+                out.flush();
+                err << texts[k].err;
+            }
+            out << texts[k].out;
+        }
+    }
+    out.flush();
+    return failed;
+}
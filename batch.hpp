@@ -0,0 +1,30 @@
+#ifndef __BATCH_HPP__
+#define __BATCH_HPP__
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "matrix.hpp"
+
+// work done for one record of a batch. source is the input file and record
+// the record's position in it (from 0); whatever is written to out and err
+// is kept with the record.
+using BatchFn = std::function<void(const std::string &source, std::size_t record, const Matrix &a,
+                                   const Matrix &b, std::ostream &out, std::ostream &err)>;
+
+// run fn over every record of every input (see load_matrix_records()) on
+// the thread pool. an input that is a directory stands for the regular
+// files directly inside it, in sorted order, and source names each file.
+// inputs load in parallel; records are then processed a
+// window at a time, each into an output buffer that is reused for the
+// following windows, and their text goes to out and err in input order
+// (each record's err text ahead of its out text). an input that cannot be
+// loaded reports "Error: <reason>" and "Error loading matrices from file:
+// <name>" on err in its place. returns the number of such inputs.
+std::size_t run_batch(const std::vector<std::string> &inputs, const BatchFn &fn, std::ostream &out,
+                      std::ostream &err);
+
+#endif // __BATCH_HPP__
@@ -0,0 +1,81 @@
+#include "density.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace {
+
+// below this size the dense kernels win whatever the density. the limits
+// below are where the sparse kernels stopped beating gemm on 1536 x 1536
+// products with random and tile-clustered nonzeros.
+constexpr std::size_t kMinSparseSize = 64;
+// densest matrix CSR is worth it for
+constexpr double kMaxCsrDensity = 0.15;
+// densest matrix, and emptiest occupied tiles, the tile kernel is worth it
+// for; below this fill the gemm on each tile row does too much padding
+constexpr double kMaxBlockedDensity = 0.4;
+constexpr double kMinBlockFill = 0.75;
+
+} // namespace
+
+double DensityStats::density() const {
+    return n == 0 ? 0.0 : static_cast<double>(nonzeros) / (static_cast<double>(n) * static_cast<double>(n));
+}
+
+double DensityStats::block_fill() const {
+    return blocks == 0 ? 0.0 : static_cast<double>(nonzeros) / static_cast<double>(blocks * kBlock * kBlock);
+}
+
+DensityStats sample_density(const Matrix &m, std::size_t sample_rows) {
+    constexpr std::size_t kB = DensityStats::kBlock;
+    const std::size_t n = m.size();
+    const std::size_t tile_rows = (n + kB - 1) / kB;
+    const std::size_t samples = std::min(tile_rows, std::max<std::size_t>(1, sample_rows));
+
+    DensityStats stats;
+    stats.n = n;
+    if (n == 0) {
+        return stats;
+    }
+
+    // sample s covers tile row s * tile_rows / samples
+    std::vector<std::size_t> nonzeros(samples, 0), blocks(samples, 0);
+    default_thread_pool().parallel_for(samples, [&](std::size_t s) {
+        const std::size_t first = s * tile_rows / samples * kB;
+        const std::size_t last = std::min(n, first + kB);
+        std::vector<unsigned char> occupied(tile_rows, 0);
+        std::size_t count = 0;
+        for (std::size_t i = first; i < last; ++i) {
+            const Matrix::RowReader row = m.row_reader(i);
+            for (std::size_t j = 0; j < n; ++j) {
+                if (row[j] != 0) {
+                    ++count;
+                    occupied[j / kB] = 1;
+                }
+            }
+        }
+        nonzeros[s] = count;
+        blocks[s] = static_cast<std::size_t>(std::count(occupied.begin(), occupied.end(), 1));
+    }, 1);
+
+    std::size_t sampled_nonzeros = 0, sampled_blocks = 0;
+    for (std::size_t s = 0; s < samples; ++s) {
+        sampled_nonzeros += nonzeros[s];
+        sampled_blocks += blocks[s];
+    }
+    stats.nonzeros = sampled_nonzeros * tile_rows / samples;
+    stats.blocks = sampled_blocks * tile_rows / samples;
+    return stats;
+}
+
+StorageFormat choose_format(const DensityStats &stats) {
+    if (stats.n < kMinSparseSize) {
+        return StorageFormat::dense;
+    }
+    if (stats.block_fill() >= kMinBlockFill && stats.density() <= kMaxBlockedDensity) {
+        return StorageFormat::blocked;
+    }
+    return stats.density() <= kMaxCsrDensity ? StorageFormat::csr : StorageFormat::dense;
+}
@@ -0,0 +1,49 @@
+#ifndef __DENSITY_HPP__
+#define __DENSITY_HPP__
+
+#include <cstddef>
+
+#include "aligned_allocator.hpp"
+#include "matrix.hpp"
+
+// how many elements of an N x N matrix are nonzero, and how they cluster:
+// blocks counts the kBlock x kBlock tiles (tiles on the right and bottom
+// edges are cut short) that hold at least one nonzero. gathered exactly by
+// the parallel text loader as it stores each element, or estimated by
+// sample_density().
+struct DensityStats {
+    // one cache line of ints, the tile BlockSparseMatrix stores
+    static constexpr std::size_t kBlock = kCacheLine / sizeof(int);
+
+    std::size_t n = 0;
+    std::size_t nonzeros = 0;
+    std::size_t blocks = 0;
+
+    // nonzeros / N^2 (0 for an empty matrix)
+    double density() const;
+    // nonzeros / (blocks * kBlock^2): how full the occupied tiles are
+    double block_fill() const;
+};
+
+// the storage a matrix is kept in for arithmetic
+enum class StorageFormat {
+    // Matrix, multiplied with gemm
+    dense,
+    // SparseMatrix, compressed rows
+    csr,
+    // BlockSparseMatrix, dense kBlock x kBlock tiles
+    blocked,
+};
+
+// counts of m from up to sample_rows rows of tiles spread evenly over it,
+// scaled to the whole matrix; exact when m has no more tile rows than that
+DensityStats sample_density(const Matrix &m, std::size_t sample_rows = 64);
+
+// the format whose product kernel is fastest for a matrix with these
+// counts: blocked when the occupied tiles are at least three quarters full
+// and no more than 40% of the matrix is nonzero, CSR for scattered
+// nonzeros up to 15% of the matrix, and dense for anything else or
+// anything under 64 x 64.
+StorageFormat choose_format(const DensityStats &stats);
+
+#endif // __DENSITY_HPP__
@@ -0,0 +1,148 @@
+#ifndef __FIXED_MATRIX_HPP__
+#define __FIXED_MATRIX_HPP__
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "matrix.hpp"
+#include "wrapping.hpp"
+
+// N x N matrix whose size is part of its type, for the tiny shapes (3 x 3,
+// 4 x 4) where Matrix's heap panels and loops cost more than the arithmetic.
+// the elements live inline (on the stack for a local), and every operation
+// is expanded over std::index_sequence, so there are no loops left for the
+// compiler to unroll and everything is usable in constant expressions.
+// arithmetic wraps like Matrix, so overflow is never undefined, even in a
+// constant expression.
+template <std::size_t N>
+class FixedMatrix {
+    static_assert(N > 0, "FixedMatrix needs at least one row");
+
+public:
+    // all zeros
+    constexpr FixedMatrix() = default;
+
+    // rows of values, e.g. FixedMatrix<2>({{1, 2}, {3, 4}})
+    constexpr FixedMatrix(const int (&values)[N][N]) {
+        fill(values, std::make_index_sequence<N * N>{});
+    }
+
+    // copy of a Matrix; throws std::runtime_error if it is not N x N
+    explicit FixedMatrix(const Matrix &m) {
+        if (static_cast<std::size_t>(m.get_size()) != N) {
+            throw std::runtime_error("Matrix dimensions must match: expected " + std::to_string(N) + ", got " +
+                                     std::to_string(m.get_size()));
+        }
+        for (std::size_t i = 0; i < N; ++i) {
+            const Matrix::RowReader row = m.row_reader(i);
+            for (std::size_t j = 0; j < N; ++j) {
+                data_[i * N + j] = row[j];
+            }
+        }
+    }
+
+    // the same values as a dynamic Matrix
+    Matrix to_matrix() const {
+        Matrix m(N);
+        for (std::size_t i = 0; i < N; ++i) {
+            int *row = m.row(i);
+            for (std::size_t j = 0; j < N; ++j) {
+                row[j] = data_[i * N + j];
+            }
+        }
+        return m;
+    }
+
+    static constexpr std::size_t get_size() { return N; }
+
+    // bounds-checked like Matrix (std::out_of_range)
+    constexpr int get_value(std::size_t i, std::size_t j) const {
+        check_index(i, j);
+        return data_[i * N + j];
+    }
+    constexpr void set_value(std::size_t i, std::size_t j, int value) {
+        check_index(i, j);
+        data_[i * N + j] = value;
+    }
+
+    constexpr int sum_diagonal_major() const {
+        return major(std::make_index_sequence<N>{});
+    }
+    constexpr int sum_diagonal_minor() const {
+        return minor(std::make_index_sequence<N>{});
+    }
+
+    friend constexpr FixedMatrix operator+(const FixedMatrix &a, const FixedMatrix &b) {
+        return add(a, b, std::make_index_sequence<N * N>{});
+    }
+    friend constexpr FixedMatrix operator*(const FixedMatrix &a, const FixedMatrix &b) {
+        return multiply(a, b, std::make_index_sequence<N * N>{});
+    }
+
+    friend constexpr bool operator==(const FixedMatrix &a, const FixedMatrix &b) {
+        return equal(a, b, std::make_index_sequence<N * N>{});
+    }
+    friend constexpr bool operator!=(const FixedMatrix &a, const FixedMatrix &b) {
+        return !(a == b);
+    }
+
+private:
+    static constexpr void check_index(std::size_t i, std::size_t j) {
+        if (i >= N || j >= N) {
+            throw std::out_of_range("Matrix index (" + std::to_string(i) + ", " + std::to_string(j) +
+                                    ") out of bounds for size " + std::to_string(N));
+        }
+    }
+
+    template <std::size_t... I>
+    constexpr void fill(const int (&values)[N][N], std::index_sequence<I...>) {
+        ((data_[I] = values[I / N][I % N]), ...);
+    }
+
+    template <std::size_t... I>
+    constexpr int major(std::index_sequence<I...>) const {
+        int sum = 0;
+        ((sum = wrapping_add(sum, data_[I * N + I])), ...);
+        return sum;
+    }
+
+    template <std::size_t... I>
+    constexpr int minor(std::index_sequence<I...>) const {
+        int sum = 0;
+        ((sum = wrapping_add(sum, data_[I * N + (N - 1 - I)])), ...);
+        return sum;
+    }
+
+    template <std::size_t... I>
+    static constexpr FixedMatrix add(const FixedMatrix &a, const FixedMatrix &b, std::index_sequence<I...>) {
+        FixedMatrix result;
+        ((result.data_[I] = wrapping_add(a.data_[I], b.data_[I])), ...);
+        return result;
+    }
+
+    // element I of a * b: row I / N of a dotted with column I % N of b
+    template <std::size_t I, std::size_t... K>
+    static constexpr int dot(const FixedMatrix &a, const FixedMatrix &b, std::index_sequence<K...>) {
+        int sum = 0;
+        ((sum = wrapping_madd(sum, a.data_[I / N * N + K], b.data_[K * N + I % N])), ...);
+        return sum;
+    }
+
+    template <std::size_t... I>
+    static constexpr FixedMatrix multiply(const FixedMatrix &a, const FixedMatrix &b, std::index_sequence<I...>) {
+        FixedMatrix result;
+        ((result.data_[I] = dot<I>(a, b, std::make_index_sequence<N>{})), ...);
+        return result;
+    }
+
+    template <std::size_t... I>
+    static constexpr bool equal(const FixedMatrix &a, const FixedMatrix &b, std::index_sequence<I...>) {
+        return ((a.data_[I] == b.data_[I]) && ...);
+    }
+
+    int data_[N * N] = {};
+};
+
+#endif // __FIXED_MATRIX_HPP__
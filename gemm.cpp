@@ -0,0 +1,223 @@
+#include "gemm.hpp"
+#include "gemm_kernels.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "scratch_arena.hpp"
+#include "thread_pool.hpp"
+#include "wrapping.hpp"
+
+namespace {
+
+std::atomic<std::size_t> g_mc{GemmTuning{}.mc};
+std::atomic<std::size_t> g_kc{GemmTuning{}.kc};
+std::atomic<std::size_t> g_nc{GemmTuning{}.nc};
+std::atomic<GemmIsa> g_isa{detect_gemm_isa()};
+
+template <typename T>
+using PackBuffer = std::vector<T, AlignedAllocator<T>>;
+
+// A is packed inside a single tile task, which never waits on the pool, so
+// a per-thread buffer reused across calls is safe
+template <typename T>
+PackBuffer<T> &a_pack_buffer() {
+    thread_local PackBuffer<T> buffer;
+    return buffer;
+}
+
+// copy A[mb x kb] into panels of mr rows, each stored k-major, summing the
+// operand's terms on the way (and converting them to the panel type T).
+// rows past mb are zero-filled so the micro-kernel never needs a ragged edge.
+template <typename In, typename T>
+void pack_a(const BasicGemmOperand<In> &a, std::size_t mb, std::size_t kb, std::size_t mr, T *dst) {
+    for (std::size_t ir = 0; ir < mb; ir += mr) {
+        const std::size_t rows = std::min(mr, mb - ir);
+        T *panel = dst + ir * kb;
+        for (std::size_t r = 0; r < rows; ++r) {
+            const In *src = a.terms[0].row(ir + r);
+            for (std::size_t p = 0; p < kb; ++p) {
+                panel[p * mr + r] = src[p];
+            }
+            for (std::size_t t = 1; t < a.count; ++t) {
+                src = a.terms[t].row(ir + r);
+                for (std::size_t p = 0; p < kb; ++p) {
+                    panel[p * mr + r] = wrapping_add<T>(panel[p * mr + r], src[p]);
+                }
+            }
+        }
+        for (std::size_t r = rows; r < mr; ++r) {
+            for (std::size_t p = 0; p < kb; ++p) {
+                panel[p * mr + r] = 0;
+            }
+        }
+    }
+}
+
+// copy B[kb x nb] into strips of nr columns, each stored k-major, summing
+// the operand's terms and zero-padding past nb
+template <typename In, typename T>
+void pack_b(const BasicGemmOperand<In> &b, std::size_t kb, std::size_t nb, std::size_t nr, T *dst) {
+    for (std::size_t jr = 0; jr < nb; jr += nr) {
+        const std::size_t cols = std::min(nr, nb - jr);
+        for (std::size_t p = 0; p < kb; ++p) {
+            const In *src = b.terms[0].row(p) + jr;
+            std::copy(src, src + cols, dst);
+            for (std::size_t t = 1; t < b.count; ++t) {
+                src = b.terms[t].row(p) + jr;
+                for (std::size_t j = 0; j < cols; ++j) {
+                    dst[j] = wrapping_add<T>(dst[j], src[j]);
+                }
+            }
+            std::fill(dst + cols, dst + nr, 0);
+            dst += nr;
+        }
+    }
+}
+
+// run the micro-kernel over every mr x nr tile of an mb x nb block of C
+template <typename T>
+void macro_kernel(const BasicMicroKernel<T> &kernel, const T *a_packed, const T *b_packed,
+                  BasicMatrixView<T> c, std::size_t mb, std::size_t nb, std::size_t kb) {
+    const std::size_t mr = kernel.mr;
+    const std::size_t nr = kernel.nr;
+    // edge tiles accumulate into a scratch tile that is then added to C
+    alignas(kCacheLine) T edge[kMaxMr * kMaxNr] = {};
+    T *rows[kMaxMr];
+
+    for (std::size_t jr = 0; jr < nb; jr += nr) {
+        const std::size_t cols = std::min(nr, nb - jr);
+        const T *b_strip = b_packed + jr * kb;
+        for (std::size_t ir = 0; ir < mb; ir += mr) {
+            const std::size_t row_count = std::min(mr, mb - ir);
+            const T *a_panel = a_packed + ir * kb;
+            if (row_count == mr && cols == nr) {
+                for (std::size_t r = 0; r < mr; ++r) {
+                    rows[r] = c.row(ir + r) + jr;
+                }
+                kernel.fn(kb, a_panel, b_strip, rows);
+                continue;
+            }
+            std::fill(edge, edge + mr * nr, 0);
+            for (std::size_t r = 0; r < mr; ++r) {
+                rows[r] = edge + r * nr;
+            }
+            kernel.fn(kb, a_panel, b_strip, rows);
+            for (std::size_t r = 0; r < row_count; ++r) {
+                T *dst = c.row(ir + r) + jr;
+                for (std::size_t j = 0; j < cols; ++j) {
+                    dst[j] = wrapping_add(dst[j], rows[r][j]);
+                }
+            }
+        }
+    }
+}
+
+// C[m x n] += A * B with operands of type In packed into panels of type T
+// for the given micro-kernel
+template <typename In, typename T>
+void gemm_blocked(const BasicGemmOperand<In> &a, const BasicGemmOperand<In> &b, BasicMatrixView<T> c,
+                  std::size_t m, std::size_t n, std::size_t k, const BasicMicroKernel<T> &kernel) {
+    const GemmTuning t = gemm_tuning();
+    ThreadPool &pool = default_thread_pool();
+
+    // C is cut into mc x nc tiles that are handed to the pool one by one, so
+    // idle threads steal leftover tiles. shrink mc when there would otherwise
+    // be fewer tiles than threads.
+    const std::size_t nc = (t.nc + kernel.nr - 1) / kernel.nr * kernel.nr;
+    const std::size_t col_blocks = (n + nc - 1) / nc;
+    const std::size_t per_thread = (m * col_blocks + pool.size() - 1) / pool.size();
+    const std::size_t mc = std::max(kernel.mr, std::min(t.mc, (per_thread + kernel.mr - 1) / kernel.mr * kernel.mr));
+    const std::size_t row_blocks = (m + mc - 1) / mc;
+
+    // packed B outlives the waits on the pool, where this thread may pick up
+    // another gemm, so it lives in a leased arena rather than per thread
+    ArenaLease lease;
+    const std::size_t b_count = col_blocks * nc * std::min(t.kc, k);
+    lease->reserve(ScratchArena::ints_for<T>(b_count));
+    T *b_data = lease->take_as<T>(b_count);
+
+    // each kc slice of B is packed once (a strip of nr columns at a time, so
+    // the block starting at column jc lives at offset jc * kb) and shared by
+    // every tile; each thread packs its own rows of A
+    for (std::size_t pc = 0; pc < k; pc += t.kc) {
+        const std::size_t kb = std::min(t.kc, k - pc);
+        pool.parallel_for(col_blocks, [&](std::size_t block) {
+            const std::size_t jc = block * nc;
+            const std::size_t nb = std::min(nc, n - jc);
+            pack_b(b.offset(pc, jc), kb, nb, kernel.nr, b_data + jc * kb);
+        }, 1);
+
+        pool.parallel_for(row_blocks * col_blocks, [&](std::size_t tile) {
+            const std::size_t ic = tile / col_blocks * mc;
+            const std::size_t jc = tile % col_blocks * nc;
+            const std::size_t mb = std::min(mc, m - ic);
+            const std::size_t nb = std::min(nc, n - jc);
+            const std::size_t mb_padded = (mb + kernel.mr - 1) / kernel.mr * kernel.mr;
+            PackBuffer<T> &a_packed = a_pack_buffer<T>();
+            a_packed.resize(std::max(a_packed.size(), mb_padded * kb));
+            pack_a(a.offset(ic, pc), mb, kb, kernel.mr, a_packed.data());
+            macro_kernel(kernel, a_packed.data(), b_data + jc * kb,
+                         c.offset(ic, jc), mb, nb, kb);
+        }, 1);
+    }
+}
+
+} // namespace
+
+void set_gemm_tuning(const GemmTuning &tuning) {
+    if (tuning.mc == 0 || tuning.kc == 0 || tuning.nc == 0) {
+        throw std::invalid_argument("gemm block sizes must be non-zero");
+    }
+    g_mc = tuning.mc;
+    g_kc = tuning.kc;
+    g_nc = tuning.nc;
+}
+
+GemmTuning gemm_tuning() {
+    GemmTuning tuning;
+    tuning.mc = g_mc;
+    tuning.kc = g_kc;
+    tuning.nc = g_nc;
+    return tuning;
+}
+
+GemmIsa gemm_isa() {
+    return g_isa;
+}
+
+void set_gemm_isa(GemmIsa isa) {
+    if (!gemm_isa_supported(isa)) {
+        throw std::invalid_argument("gemm instruction set not supported by this CPU");
+    }
+    g_isa = isa;
+}
+
+
+template <typename T>
+void gemm(const BasicGemmOperand<T> &a, const BasicGemmOperand<T> &b, BasicMatrixView<T> c,
+          std::size_t m, std::size_t n, std::size_t k) {
+    gemm_blocked(a, b, c, m, n, k, micro_kernel<T>(gemm_isa()));
+}
+
+void gemm_widened(const GemmOperand &a, const GemmOperand &b, BasicMatrixView<std::int64_t> c,
+                  std::size_t m, std::size_t n, std::size_t k) {
+    gemm_blocked(a, b, c, m, n, k, widening_micro_kernel(gemm_isa()));
+}
+
+template void gemm<std::int8_t>(const BasicGemmOperand<std::int8_t> &, const BasicGemmOperand<std::int8_t> &,
+                                BasicMatrixView<std::int8_t>, std::size_t, std::size_t, std::size_t);
+template void gemm<std::int16_t>(const BasicGemmOperand<std::int16_t> &, const BasicGemmOperand<std::int16_t> &,
+                                 BasicMatrixView<std::int16_t>, std::size_t, std::size_t, std::size_t);
+template void gemm<int>(const BasicGemmOperand<int> &, const BasicGemmOperand<int> &,
+                        BasicMatrixView<int>, std::size_t, std::size_t, std::size_t);
+template void gemm<std::int64_t>(const BasicGemmOperand<std::int64_t> &, const BasicGemmOperand<std::int64_t> &,
+                                 BasicMatrixView<std::int64_t>, std::size_t, std::size_t, std::size_t);
+template void gemm<float>(const BasicGemmOperand<float> &, const BasicGemmOperand<float> &,
+                          BasicMatrixView<float>, std::size_t, std::size_t, std::size_t);
+template void gemm<double>(const BasicGemmOperand<double> &, const BasicGemmOperand<double> &,
+                           BasicMatrixView<double>, std::size_t, std::size_t, std::size_t);
@@ -0,0 +1,133 @@
+#ifndef __GEMM_HPP__
+#define __GEMM_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+// read-only view of a row-major block. rows are either evenly spaced
+// (row i starts at data + i * stride) or looked up in a table of row
+// pointers (row i starts at rows[i] + col), which lets a view cover
+// matrices whose rows live in separately allocated panels.
+template <typename T>
+struct BasicConstMatrixView {
+    const T *data = nullptr;
+    std::size_t stride = 0;
+    const T *const *rows = nullptr;
+    std::size_t col = 0;
+
+    const T *row(std::size_t i) const { return rows ? rows[i] + col : data + i * stride; }
+
+    // the same block, starting at (i, j)
+    BasicConstMatrixView offset(std::size_t i, std::size_t j) const {
+        return rows ? BasicConstMatrixView{nullptr, 0, rows + i, col + j} : BasicConstMatrixView{row(i) + j, stride};
+    }
+};
+
+// writable counterpart of BasicConstMatrixView
+template <typename T>
+struct BasicMatrixView {
+    T *data = nullptr;
+    std::size_t stride = 0;
+    T *const *rows = nullptr;
+    std::size_t col = 0;
+
+    T *row(std::size_t i) const { return rows ? rows[i] + col : data + i * stride; }
+
+    BasicMatrixView offset(std::size_t i, std::size_t j) const {
+        return rows ? BasicMatrixView{nullptr, 0, rows + i, col + j} : BasicMatrixView{row(i) + j, stride};
+    }
+
+    operator BasicConstMatrixView<T>() const { return BasicConstMatrixView<T>{data, stride, rows, col}; }
+};
+
+using ConstMatrixView = BasicConstMatrixView<int>;
+using MatrixView = BasicMatrixView<int>;
+
+// operand of gemm(): the element-wise sum of one or more views. the terms
+// are added together while the operand is packed, so a product like
+// (A + B) * C never materializes A + B.
+template <typename T>
+struct BasicGemmOperand {
+    static constexpr std::size_t kMaxTerms = 8;
+
+    BasicConstMatrixView<T> terms[kMaxTerms];
+    std::size_t count = 0;
+
+    BasicGemmOperand() = default;
+    BasicGemmOperand(BasicConstMatrixView<T> view) : count(1) { terms[0] = view; }
+
+    // false (and no change) once kMaxTerms terms are held
+    bool add_term(BasicConstMatrixView<T> view) {
+        if (count == kMaxTerms) {
+            return false;
+        }
+        terms[count++] = view;
+        return true;
+    }
+
+    // the same terms shifted to start at (i, j)
+    BasicGemmOperand offset(std::size_t i, std::size_t j) const {
+        BasicGemmOperand shifted;
+        for (std::size_t t = 0; t < count; ++t) {
+            shifted.add_term(terms[t].offset(i, j));
+        }
+        return shifted;
+    }
+};
+
+using GemmOperand = BasicGemmOperand<int>;
+
+// cache blocking parameters for gemm(). an mc x kc block of A and a kc x nc
+// block of B are worked on together; the defaults keep the B block (128 KiB
+// of ints at 128 x 256) in L2 and the C row segment plus the current B row in L1.
+struct GemmTuning {
+    std::size_t mc = 64;
+    std::size_t kc = 128;
+    std::size_t nc = 256;
+};
+
+// tiling used by every subsequent gemm() call. block sizes of zero are
+// rejected with std::invalid_argument.
+void set_gemm_tuning(const GemmTuning &tuning);
+GemmTuning gemm_tuning();
+
+// instruction sets with a dedicated micro-kernel. the best one the CPU
+// supports is picked once at startup (CPUID), so a single binary runs the
+// widest kernel available on each host.
+enum class GemmIsa {
+    scalar,
+    avx2,
+    avx512,
+};
+
+bool gemm_isa_supported(GemmIsa isa);
+GemmIsa detect_gemm_isa();
+
+// kernel used by gemm(). set_gemm_isa() throws std::invalid_argument if the
+// CPU cannot run the requested instruction set.
+GemmIsa gemm_isa();
+void set_gemm_isa(GemmIsa isa);
+
+// C[m x n] += A[m x k] * B[k x n]. blocks of A and B are packed into
+// contiguous panels and fed to the register-blocked micro-kernel for the
+// element type. instantiated for int8_t, int16_t, int, int64_t, float and
+// double; integer products wrap like the element type.
+template <typename T>
+void gemm(const BasicGemmOperand<T> &a, const BasicGemmOperand<T> &b, BasicMatrixView<T> c,
+          std::size_t m, std::size_t n, std::size_t k);
+
+// int form that also takes plain views
+inline void gemm(const GemmOperand &a, const GemmOperand &b, MatrixView c,
+                 std::size_t m, std::size_t n, std::size_t k) {
+    gemm<int>(a, b, c, m, n, k);
+}
+
+// C[m x n] += A[m x k] * B[k x n] for int operands with int64 accumulators
+// and result: exact as long as no sum leaves the int64 range. the operands
+// are sign-extended while they are packed and multiplied with a widening
+// 32 x 32 -> 64 bit SIMD multiply, so this costs about what gemm<int64_t>
+// does.
+void gemm_widened(const GemmOperand &a, const GemmOperand &b, BasicMatrixView<std::int64_t> c,
+                  std::size_t m, std::size_t n, std::size_t k);
+
+#endif // __GEMM_HPP__
@@ -0,0 +1,361 @@
+#include "gemm_kernels.hpp"
+
+#include <cstdint>
+
+#include "wrapping.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM_HAVE_X86 1
+#endif
+
+namespace {
+
+constexpr std::size_t kMr = 4;
+
+// portable fallback, also used on CPUs without AVX2
+constexpr std::size_t kScalarNr = 8;
+
+template <typename T>
+void kernel_scalar(std::size_t kb, const T *a, const T *b, T *const *c) {
+    T acc[kMr][kScalarNr] = {};
+    for (std::size_t p = 0; p < kb; ++p) {
+        const T *ap = a + p * kMr;
+        const T *bp = b + p * kScalarNr;
+        for (std::size_t r = 0; r < kMr; ++r) {
+            for (std::size_t j = 0; j < kScalarNr; ++j) {
+                acc[r][j] = wrapping_madd(acc[r][j], ap[r], bp[j]);
+            }
+        }
+    }
+    for (std::size_t r = 0; r < kMr; ++r) {
+        for (std::size_t j = 0; j < kScalarNr; ++j) {
+            c[r][j] = wrapping_add(c[r][j], acc[r][j]);
+        }
+    }
+}
+
+template <std::size_t Bytes>
+__attribute__((always_inline)) inline void axpy_vector(std::size_t n, int v, const int *x, int *y) {
+    typedef unsigned Vec __attribute__((vector_size(Bytes)));
+    constexpr std::size_t lanes = Bytes / sizeof(int);
+    const Vec scale = Vec{} + static_cast<unsigned>(v);
+    std::size_t j = 0;
+    for (; j + lanes <= n; j += lanes) {
+        Vec xv, yv;
+        __builtin_memcpy(&xv, x + j, Bytes);
+        __builtin_memcpy(&yv, y + j, Bytes);
+        yv += scale * xv;
+        __builtin_memcpy(y + j, &yv, Bytes);
+    }
+    for (; j < n; ++j) {
+        y[j] = wrapping_madd(y[j], v, x[j]);
+    }
+}
+
+void axpy_scalar(std::size_t n, int v, const int *x, int *y) {
+    axpy_vector<16>(n, v, x, y);
+}
+
+#ifdef GEMM_HAVE_X86
+
+__attribute__((target("avx2"))) void axpy_avx2(std::size_t n, int v, const int *x, int *y) {
+    axpy_vector<32>(n, v, x, y);
+}
+
+__attribute__((target("avx512f"))) void axpy_avx512(std::size_t n, int v, const int *x, int *y) {
+    axpy_vector<64>(n, v, x, y);
+}
+
+// 4 rows x 16 columns: eight ymm accumulators, two B loads per step
+constexpr std::size_t kAvx2Nr = 16;
+
+__attribute__((target("avx2")))
+void kernel_avx2(std::size_t kb, const int *a, const int *b, int *const *c) {
+    __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+    __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+    __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+    __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+
+    for (std::size_t p = 0; p < kb; ++p) {
+        const __m256i b0 = _mm256_load_si256(reinterpret_cast<const __m256i *>(b));
+        const __m256i b1 = _mm256_load_si256(reinterpret_cast<const __m256i *>(b + 8));
+        __m256i ar = _mm256_set1_epi32(a[0]);
+        c00 = _mm256_add_epi32(c00, _mm256_mullo_epi32(ar, b0));
+        c01 = _mm256_add_epi32(c01, _mm256_mullo_epi32(ar, b1));
+        ar = _mm256_set1_epi32(a[1]);
+        c10 = _mm256_add_epi32(c10, _mm256_mullo_epi32(ar, b0));
+        c11 = _mm256_add_epi32(c11, _mm256_mullo_epi32(ar, b1));
+        ar = _mm256_set1_epi32(a[2]);
+        c20 = _mm256_add_epi32(c20, _mm256_mullo_epi32(ar, b0));
+        c21 = _mm256_add_epi32(c21, _mm256_mullo_epi32(ar, b1));
+        ar = _mm256_set1_epi32(a[3]);
+        c30 = _mm256_add_epi32(c30, _mm256_mullo_epi32(ar, b0));
+        c31 = _mm256_add_epi32(c31, _mm256_mullo_epi32(ar, b1));
+        a += kMr;
+        b += kAvx2Nr;
+    }
+
+    const __m256i acc[kMr][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}};
+    for (std::size_t r = 0; r < kMr; ++r) {
+        __m256i *dst = reinterpret_cast<__m256i *>(c[r]);
+        _mm256_storeu_si256(dst, _mm256_add_epi32(_mm256_loadu_si256(dst), acc[r][0]));
+        _mm256_storeu_si256(dst + 1, _mm256_add_epi32(_mm256_loadu_si256(dst + 1), acc[r][1]));
+    }
+}
+
+// 4 rows x 32 columns: eight zmm accumulators
+constexpr std::size_t kAvx512Nr = 32;
+
+__attribute__((target("avx512f")))
+void kernel_avx512(std::size_t kb, const int *a, const int *b, int *const *c) {
+    __m512i c00 = _mm512_setzero_si512(), c01 = _mm512_setzero_si512();
+    __m512i c10 = _mm512_setzero_si512(), c11 = _mm512_setzero_si512();
+    __m512i c20 = _mm512_setzero_si512(), c21 = _mm512_setzero_si512();
+    __m512i c30 = _mm512_setzero_si512(), c31 = _mm512_setzero_si512();
+
+    for (std::size_t p = 0; p < kb; ++p) {
+        const __m512i b0 = _mm512_load_si512(b);
+        const __m512i b1 = _mm512_load_si512(b + 16);
+        __m512i ar = _mm512_set1_epi32(a[0]);
+        c00 = _mm512_add_epi32(c00, _mm512_mullo_epi32(ar, b0));
+        c01 = _mm512_add_epi32(c01, _mm512_mullo_epi32(ar, b1));
+        ar = _mm512_set1_epi32(a[1]);
+        c10 = _mm512_add_epi32(c10, _mm512_mullo_epi32(ar, b0));
+        c11 = _mm512_add_epi32(c11, _mm512_mullo_epi32(ar, b1));
+        ar = _mm512_set1_epi32(a[2]);
+        c20 = _mm512_add_epi32(c20, _mm512_mullo_epi32(ar, b0));
+        c21 = _mm512_add_epi32(c21, _mm512_mullo_epi32(ar, b1));
+        ar = _mm512_set1_epi32(a[3]);
+        c30 = _mm512_add_epi32(c30, _mm512_mullo_epi32(ar, b0));
+        c31 = _mm512_add_epi32(c31, _mm512_mullo_epi32(ar, b1));
+        a += kMr;
+        b += kAvx512Nr;
+    }
+
+    const __m512i acc[kMr][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}};
+    for (std::size_t r = 0; r < kMr; ++r) {
+        int *dst = c[r];
+        _mm512_storeu_si512(dst, _mm512_add_epi32(_mm512_loadu_si512(dst), acc[r][0]));
+        _mm512_storeu_si512(dst + 16, _mm512_add_epi32(_mm512_loadu_si512(dst + 16), acc[r][1]));
+    }
+}
+
+// widening kernels for gemm_widened(): the panels hold ints sign-extended
+// to 64 bits, so VPMULDQ (low signed 32 bits of each lane, full 64-bit
+// product) gives the exact product at the cost of one multiply, where a
+// general 64-bit multiply has no single instruction before AVX-512DQ.
+// 4 rows x 8 columns: eight ymm accumulators, like the int kernel
+constexpr std::size_t kWideAvx2Nr = 8;
+
+__attribute__((target("avx2")))
+void kernel_wide_avx2(std::size_t kb, const std::int64_t *a, const std::int64_t *b, std::int64_t *const *c) {
+    __m256i acc[kMr][2];
+    for (std::size_t r = 0; r < kMr; ++r) {
+        acc[r][0] = _mm256_setzero_si256();
+        acc[r][1] = _mm256_setzero_si256();
+    }
+    for (std::size_t p = 0; p < kb; ++p) {
+        const __m256i b0 = _mm256_load_si256(reinterpret_cast<const __m256i *>(b));
+        const __m256i b1 = _mm256_load_si256(reinterpret_cast<const __m256i *>(b + 4));
+        for (std::size_t r = 0; r < kMr; ++r) {
+            const __m256i ar = _mm256_set1_epi64x(a[r]);
+            acc[r][0] = _mm256_add_epi64(acc[r][0], _mm256_mul_epi32(ar, b0));
+            acc[r][1] = _mm256_add_epi64(acc[r][1], _mm256_mul_epi32(ar, b1));
+        }
+        a += kMr;
+        b += kWideAvx2Nr;
+    }
+    for (std::size_t r = 0; r < kMr; ++r) {
+        __m256i *dst = reinterpret_cast<__m256i *>(c[r]);
+        _mm256_storeu_si256(dst, _mm256_add_epi64(_mm256_loadu_si256(dst), acc[r][0]));
+        _mm256_storeu_si256(dst + 1, _mm256_add_epi64(_mm256_loadu_si256(dst + 1), acc[r][1]));
+    }
+}
+
+// 8 rows x 16 columns: sixteen of the 32 zmm registers accumulate
+constexpr std::size_t kWideAvx512Mr = 8;
+constexpr std::size_t kWideAvx512Nr = 16;
+
+__attribute__((target("avx512f")))
+void kernel_wide_avx512(std::size_t kb, const std::int64_t *a, const std::int64_t *b, std::int64_t *const *c) {
+    __m512i acc[kWideAvx512Mr][2];
+    for (std::size_t r = 0; r < kWideAvx512Mr; ++r) {
+        acc[r][0] = _mm512_setzero_si512();
+        acc[r][1] = _mm512_setzero_si512();
+    }
+    for (std::size_t p = 0; p < kb; ++p) {
+        const __m512i b0 = _mm512_load_si512(b);
+        const __m512i b1 = _mm512_load_si512(b + 8);
+        // the all-lanes masked form is the same VPMULDQ; the unmasked
+        // intrinsic trips a false -Wmaybe-uninitialized in GCC 12's header
+        for (std::size_t r = 0; r < kWideAvx512Mr; ++r) {
+            const __m512i ar = _mm512_set1_epi64(a[r]);
+            acc[r][0] = _mm512_add_epi64(acc[r][0], _mm512_maskz_mul_epi32(0xff, ar, b0));
+            acc[r][1] = _mm512_add_epi64(acc[r][1], _mm512_maskz_mul_epi32(0xff, ar, b1));
+        }
+        a += kWideAvx512Mr;
+        b += kWideAvx512Nr;
+    }
+    for (std::size_t r = 0; r < kWideAvx512Mr; ++r) {
+        std::int64_t *dst = c[r];
+        _mm512_storeu_si512(dst, _mm512_add_epi64(_mm512_loadu_si512(dst), acc[r][0]));
+        _mm512_storeu_si512(dst + 8, _mm512_add_epi64(_mm512_loadu_si512(dst + 8), acc[r][1]));
+    }
+}
+
+// 4 rows x two vectors of Bytes, for every element type but int. the body
+// is written with GCC vector extensions and always inlined, so it is
+// compiled with the instruction set of the kernel it is inlined into.
+template <typename T, std::size_t Bytes>
+__attribute__((always_inline)) inline void kernel_vector(std::size_t kb, const T *a, const T *b, T *const *c) {
+    // integer lanes are unsigned so that they wrap
+    using Lane = wrapping_lane_t<T>;
+    typedef Lane Vec __attribute__((vector_size(Bytes)));
+    constexpr std::size_t lanes = Bytes / sizeof(T);
+
+    Vec acc[kMr][2] = {};
+    for (std::size_t p = 0; p < kb; ++p) {
+        Vec b0, b1;
+        __builtin_memcpy(&b0, b, Bytes);
+        __builtin_memcpy(&b1, b + lanes, Bytes);
+        for (std::size_t r = 0; r < kMr; ++r) {
+            const Vec ar = Vec{} + static_cast<Lane>(a[r]);
+            acc[r][0] += ar * b0;
+            acc[r][1] += ar * b1;
+        }
+        a += kMr;
+        b += 2 * lanes;
+    }
+
+    for (std::size_t r = 0; r < kMr; ++r) {
+        Vec c0, c1;
+        __builtin_memcpy(&c0, c[r], Bytes);
+        __builtin_memcpy(&c1, c[r] + lanes, Bytes);
+        c0 += acc[r][0];
+        c1 += acc[r][1];
+        __builtin_memcpy(c[r], &c0, Bytes);
+        __builtin_memcpy(c[r] + lanes, &c1, Bytes);
+    }
+}
+
+template <typename T>
+__attribute__((target("avx2")))
+void kernel_vector_avx2(std::size_t kb, const T *a, const T *b, T *const *c) {
+    kernel_vector<T, 32>(kb, a, b, c);
+}
+
+template <typename T>
+__attribute__((target("avx512f")))
+void kernel_vector_avx512(std::size_t kb, const T *a, const T *b, T *const *c) {
+    kernel_vector<T, 64>(kb, a, b, c);
+}
+
+#endif // GEMM_HAVE_X86
+
+const MicroKernel kScalarKernel{GemmIsa::scalar, kMr, kScalarNr, kernel_scalar<int>};
+#ifdef GEMM_HAVE_X86
+const MicroKernel kAvx2Kernel{GemmIsa::avx2, kMr, kAvx2Nr, kernel_avx2};
+const MicroKernel kAvx512Kernel{GemmIsa::avx512, kMr, kAvx512Nr, kernel_avx512};
+#endif
+
+} // namespace
+
+bool gemm_isa_supported(GemmIsa isa) {
+#ifdef GEMM_HAVE_X86
+    // may run from a static initializer, before the CPU model is cached
+    __builtin_cpu_init();
+#endif
+    switch (isa) {
+    case GemmIsa::scalar:
+        return true;
+#ifdef GEMM_HAVE_X86
+    case GemmIsa::avx2:
+        return __builtin_cpu_supports("avx2");
+    case GemmIsa::avx512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+GemmIsa detect_gemm_isa() {
+    if (gemm_isa_supported(GemmIsa::avx512)) {
+        return GemmIsa::avx512;
+    }
+    if (gemm_isa_supported(GemmIsa::avx2)) {
+        return GemmIsa::avx2;
+    }
+    return GemmIsa::scalar;
+}
+
+template <>
+const MicroKernel &micro_kernel<int>(GemmIsa isa) {
+    switch (isa) {
+#ifdef GEMM_HAVE_X86
+    case GemmIsa::avx2:
+        return kAvx2Kernel;
+    case GemmIsa::avx512:
+        return kAvx512Kernel;
+#endif
+    default:
+        return kScalarKernel;
+    }
+}
+
+template <typename T>
+const BasicMicroKernel<T> &micro_kernel(GemmIsa isa) {
+    static const BasicMicroKernel<T> scalar{GemmIsa::scalar, kMr, kScalarNr, kernel_scalar<T>};
+#ifdef GEMM_HAVE_X86
+    static const BasicMicroKernel<T> avx2{GemmIsa::avx2, kMr, 2 * 32 / sizeof(T), kernel_vector_avx2<T>};
+    static const BasicMicroKernel<T> avx512{GemmIsa::avx512, kMr, 2 * 64 / sizeof(T), kernel_vector_avx512<T>};
+#endif
+    switch (isa) {
+#ifdef GEMM_HAVE_X86
+    case GemmIsa::avx2:
+        return avx2;
+    case GemmIsa::avx512:
+        return avx512;
+#endif
+    default:
+        return scalar;
+    }
+}
+
+const BasicMicroKernel<std::int64_t> &widening_micro_kernel(GemmIsa isa) {
+    static const BasicMicroKernel<std::int64_t> scalar{GemmIsa::scalar, kMr, kScalarNr, kernel_scalar<std::int64_t>};
+#ifdef GEMM_HAVE_X86
+    static const BasicMicroKernel<std::int64_t> avx2{GemmIsa::avx2, kMr, kWideAvx2Nr, kernel_wide_avx2};
+    static const BasicMicroKernel<std::int64_t> avx512{GemmIsa::avx512, kWideAvx512Mr, kWideAvx512Nr, kernel_wide_avx512};
+#endif
+    switch (isa) {
+#ifdef GEMM_HAVE_X86
+    case GemmIsa::avx2:
+        return avx2;
+    case GemmIsa::avx512:
+        return avx512;
+#endif
+    default:
+        return scalar;
+    }
+}
+
+AxpyFn axpy_kernel(GemmIsa isa) {
+    switch (isa) {
+#ifdef GEMM_HAVE_X86
+    case GemmIsa::avx512:
+        return axpy_avx512;
+    case GemmIsa::avx2:
+        return axpy_avx2;
+#endif
+    default:
+        return axpy_scalar;
+    }
+}
+
+template const BasicMicroKernel<std::int8_t> &micro_kernel<std::int8_t>(GemmIsa);
+template const BasicMicroKernel<std::int16_t> &micro_kernel<std::int16_t>(GemmIsa);
+template const BasicMicroKernel<std::int64_t> &micro_kernel<std::int64_t>(GemmIsa);
+template const BasicMicroKernel<float> &micro_kernel<float>(GemmIsa);
+template const BasicMicroKernel<double> &micro_kernel<double>(GemmIsa);
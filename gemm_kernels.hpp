@@ -0,0 +1,48 @@
+#ifndef __GEMM_KERNELS_HPP__
+#define __GEMM_KERNELS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gemm.hpp"
+
+// register-blocked micro-kernel: C[mr x nr] += A[mr x kb] * B[kb x nr].
+// a is packed k-major (mr values per step), b is packed k-major (nr values
+// per step), and c holds mr row pointers with nr writable elements each.
+template <typename T>
+using BasicMicroKernelFn = void (*)(std::size_t kb, const T *a, const T *b, T *const *c);
+using MicroKernelFn = BasicMicroKernelFn<int>;
+
+// upper bounds on the tile shape of any kernel, used to size scratch tiles
+// (nr counts elements, so the narrow types have the widest tiles)
+constexpr std::size_t kMaxMr = 8;
+constexpr std::size_t kMaxNr = 128;
+
+template <typename T>
+struct BasicMicroKernel {
+    GemmIsa isa;
+    std::size_t mr;
+    std::size_t nr;
+    BasicMicroKernelFn<T> fn;
+};
+using MicroKernel = BasicMicroKernel<int>;
+
+// micro-kernel for the requested instruction set and element type. int has
+// hand-written intrinsics kernels; the other types share one kernel body
+// written with vector extensions and compiled once per instruction set.
+template <typename T>
+const BasicMicroKernel<T> &micro_kernel(GemmIsa isa);
+template <>
+const BasicMicroKernel<int> &micro_kernel<int>(GemmIsa isa);
+
+// kernels for gemm_widened(). a and b hold ints sign-extended to int64, which
+// lets the SIMD forms use the 32 x 32 -> 64 bit multiply.
+const BasicMicroKernel<std::int64_t> &widening_micro_kernel(GemmIsa isa);
+
+// y[0, n) += v * x[0, n), the row update of the sparse and structured
+// kernels, which have no dense block to hand to gemm(). compiled once per
+// instruction set like the micro-kernels.
+using AxpyFn = void (*)(std::size_t n, int v, const int *x, int *y);
+AxpyFn axpy_kernel(GemmIsa isa);
+
+#endif // __GEMM_KERNELS_HPP__
@@ -1,163 +1,262 @@
 #include <iostream>
 #include <vector>
-#include <fstream>
 #include <string>
 #include <iomanip>   // for std::setw
 #include <stdexcept> // for exception handling
 #include <limits>    // for numeric_limits
+#include <future>
+#include <sstream>
 
-// define a type alias
-using Matrix = std::vector<std::vector<int>>;
+#include "accumulation.hpp"
+#include "adaptive_matrix.hpp"
+#include "batch.hpp"
+#include "matrix.hpp"
+#include "matrix_io.hpp"
+#include "matrix_writer.hpp"
 
 // function declarations
-bool loadMatrices(const std::string &filename, Matrix &matrixA, Matrix &matrixB, int &n);
-void printMatrix(const Matrix &matrix, const std::string &label);
+bool awaitMatrix(const AsyncMatrixLoad &load, bool first, Matrix &matrix);
+void writeReport(const Matrix &matrixA, const Matrix &matrixB, std::ostream &out, std::ostream &err);
+void printMatrix(const Matrix &matrix, const std::string &label, std::ostream &out = std::cout);
 Matrix addMatrices(const Matrix &matrixA, const Matrix &matrixB);
-Matrix multiplyMatrices(const Matrix &matrixA, const Matrix &matrixB);
-void sumDiagonals(const Matrix &matrix);
-void swapRows(Matrix &matrix, int row1, int row2);
-void swapCols(Matrix &matrix, int col1, int col2);
-void updateElement(Matrix &matrix, int row, int col, int newValue);
-
-// main function
-int main()
+Matrix multiplyMatrices(const AdaptiveMatrix &matrixA, const AdaptiveMatrix &matrixB, std::ostream &err = std::cerr);
+void writeProduct(const AdaptiveMatrix &matrixA, const AdaptiveMatrix &matrixB, std::ostream &out, std::ostream &err);
+void sumDiagonals(const Matrix &matrix, std::ostream &out = std::cout, std::ostream &err = std::cerr);
+void swapRows(Matrix &matrix, int row1, int row2, std::ostream &err = std::cerr);
+void swapCols(Matrix &matrix, int col1, int col2, std::ostream &err = std::cerr);
+void updateElement(Matrix &matrix, int row, int col, int newValue, std::ostream &err = std::cerr);
+
+// what one step of the program writes to stdout and stderr. steps run in
+// the background as soon as their inputs are loaded and their text is
+// written in program order.
+struct StepOutput
 {
+    std::string out;
+    std::string err;
+};
+
+/**
+ * @brief starts a step on its own thread, capturing what it writes
+ * @param fn callable taking (std::ostream &out, std::ostream &err)
+ * @return the step's text, once it has run
+ */
+template <typename Fn>
+std::future<StepOutput> runStep(Fn fn)
+{
+    return std::async(std::launch::async, [fn]() {
+        std::ostringstream out, err;
+        fn(out, err);
+        return StepOutput{out.str(), err.str()};
+    });
+}
+
+/**
+ * @brief waits for a step and writes its text
+ * @param step the step started by runStep
+ */
+void writeStep(std::future<StepOutput> &step)
+{
+    const StepOutput text = step.get();
+    if (!text.err.empty())
+    {
+        std::cout.flush();
+        std::cerr << text.err;
+    }
+    std::cout << text.out;
+}
+
+// main function. with file or directory arguments, every N / A / B record
+// in those files (and in the files directly inside those directories) is
+// processed as a batch; otherwise one input file is named on stdin.
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        const std::vector<std::string> inputs(argv + 1, argv + argc);
+        const std::size_t failed = run_batch(inputs,
+            [](const std::string &source, std::size_t record, const Matrix &matrixA, const Matrix &matrixB,
+               std::ostream &out, std::ostream &err) {
+                out << "==> " << source << " (record " << record << ") <==\n";
+                writeReport(matrixA, matrixB, out, err);
+                out << "\n";
+            },
+            std::cout, std::cerr);
+        return failed == 0 ? 0 : 1;
+    }
+
     std::string filename;
-    Matrix matrixA, matrixB;
-    int n = 0;
 
     std::cout << "Enter the input filename: ";
     std::cin >> filename;
 
-    if (!loadMatrices(filename, matrixA, matrixB, n))
+    // A is handed out while B is still being parsed, so the steps that only
+    // need A start first; nothing is printed until both loaded cleanly
+    AsyncMatrixLoad load(filename);
+    Matrix matrixA(0), matrixB(0);
+    if (!awaitMatrix(load, true, matrixA))
     {
         std::cerr << "Error loading matrices from file: " << filename << std::endl;
         return 1;
     }
 
-    std::cout << "\nMatrices loaded" << std::endl;
-    printMatrix(matrixA, "Matrix A:");
-    printMatrix(matrixB, "Matrix B:");
-
-    std::cout << "\nMatrix Addition" << std::endl;
-    Matrix sumMatrix = addMatrices(matrixA, matrixB);
-    printMatrix(sumMatrix, "Result (A + B):");
-
-    std::cout << "\nMatrix Multiplication" << std::endl;
-    Matrix productMatrix = multiplyMatrices(matrixA, matrixB);
-    printMatrix(productMatrix, "Result (A * B):");
+    auto printA = runStep([matrixA](std::ostream &out, std::ostream &) {
+        printMatrix(matrixA, "Matrix A:", out);
+    });
+    auto diagonals = runStep([matrixA](std::ostream &out, std::ostream &err) {
+        sumDiagonals(matrixA, out, err);
+    });
+    auto rowSwap = runStep([matrixA](std::ostream &out, std::ostream &err) {
+        Matrix matrixA_copy_rows = matrixA;
+        swapRows(matrixA_copy_rows, 0, 1, err);
+        printMatrix(matrixA_copy_rows, "Matrix A after row swap:", out);
+    });
+    auto update = runStep([matrixA](std::ostream &out, std::ostream &err) {
+        Matrix matrixA_copy_update = matrixA; // Work on a copy
+        updateElement(matrixA_copy_update, 2, 2, 99, err);
+        printMatrix(matrixA_copy_update, "Matrix A after update:", out);
+    });
+
+    if (!awaitMatrix(load, false, matrixB))
+    {
+        std::cerr << "Error loading matrices from file: " << filename << std::endl;
+        return 1;
+    }
 
-    std::cout << "\nDiagonal Sums (Matrix A)" << std::endl;
-    sumDiagonals(matrixA);
+    auto printB = runStep([matrixB](std::ostream &out, std::ostream &) {
+        printMatrix(matrixB, "Matrix B:", out);
+    });
+    auto sum = runStep([matrixA, matrixB](std::ostream &out, std::ostream &) {
+        printMatrix(addMatrices(matrixA, matrixB), "Result (A + B):", out);
+    });
+    // the loader counted each matrix's nonzeros while parsing it, which
+    // picks the storage and kernel for the product
+    const DensityStats statsA = load.a_stats(), statsB = load.b_stats();
+    auto product = runStep([matrixA, matrixB, statsA, statsB](std::ostream &out, std::ostream &err) {
+        writeProduct(AdaptiveMatrix(matrixA, statsA), AdaptiveMatrix(matrixB, statsB), out, err);
+    });
+    auto colSwap = runStep([matrixB](std::ostream &out, std::ostream &err) {
+        Matrix matrixB_copy_cols = matrixB; // Work on a copy
+        swapCols(matrixB_copy_cols, 1, 2, err);
+        printMatrix(matrixB_copy_cols, "Matrix B after column swap:", out);
+    });
+
+    std::cout << "\nMatrices loaded\n";
+    writeStep(printA);
+    writeStep(printB);
+
+    std::cout << "\nMatrix Addition\n";
+    writeStep(sum);
+
+    std::cout << "\nMatrix Multiplication\n";
+    writeStep(product);
+
+    std::cout << "\nDiagonal Sums (Matrix A)\n";
+    writeStep(diagonals);
 
     // interactive or fixed swaps/updates
-    std::cout << "\nSwapping Rows 0 and 1 of Matrix A" << std::endl;
-    Matrix matrixA_copy_rows = matrixA;
-    swapRows(matrixA_copy_rows, 0, 1);
-    printMatrix(matrixA_copy_rows, "Matrix A after row swap:");
+    std::cout << "\nSwapping Rows 0 and 1 of Matrix A\n";
+    writeStep(rowSwap);
 
-    std::cout << "\nSwapping Columns 1 and 2 of Matrix B" << std::endl;
-    Matrix matrixB_copy_cols = matrixB; // Work on a copy
-    swapCols(matrixB_copy_cols, 1, 2);
-    printMatrix(matrixB_copy_cols, "Matrix B after column swap:");
+    std::cout << "\nSwapping Columns 1 and 2 of Matrix B\n";
+    writeStep(colSwap);
 
-    std::cout << "\nUpdating Element (2, 2) in Matrix A to 99" << std::endl;
-    Matrix matrixA_copy_update = matrixA; // Work on a copy
-    updateElement(matrixA_copy_update, 2, 2, 99);
-    printMatrix(matrixA_copy_update, "Matrix A after update:");
+    std::cout << "\nUpdating Element (2, 2) in Matrix A to 99\n";
+    writeStep(update);
 
+    std::cout.flush();
     return 0; // Indicate success
 }
 
 // function implementations
 
 /**
- * @brief loads two NxN matrices from a file
- * @param filename the name of the file to read from
- * @param matrixA reference to the first matrix to load into
- * @param matrixB reference to the second matrix to load into
- * @param n reference to store the size N
+ * @brief waits for one of the two matrices of the input file
+ * @param load the background load of the input file
+ * @param first true for matrix A, false for matrix B
+ * @param matrix reference to store the loaded matrix
  * @return true if successful, false otherwise
  */
-bool loadMatrices(const std::string &filename, Matrix &matrixA, Matrix &matrixB, int &n)
+bool awaitMatrix(const AsyncMatrixLoad &load, bool first, Matrix &matrix)
 {
-    std::ifstream inFile(filename);
-    if (!inFile.is_open())
+    try
     {
-        std::cerr << "Error: Could not open file " << filename << std::endl;
-        return false;
+        matrix = first ? load.a() : load.b();
     }
-
-    // read the size N
-    if (!(inFile >> n) || n <= 0)
+    catch (const std::runtime_error &e)
     {
-        std::cerr << "Error: Invalid or missing matrix size N in file" << std::endl;
-        inFile.close();
+        std::cerr << "Error: " << e.what() << std::endl;
         return false;
     }
 
-    // resize matrices
-    matrixA.resize(n, std::vector<int>(n));
-    matrixB.resize(n, std::vector<int>(n));
+    return true;
+}
 
-    // read matrix A
-    for (int i = 0; i < n; ++i)
-    {
-        for (int j = 0; j < n; ++j)
-        {
-            if (!(inFile >> matrixA[i][j]))
-            {
-                std::cerr << "Error: Failed to read element for Matrix A at [" << i << "][" << j << "]" << std::endl;
-                inFile.close();
-                return false;
-            }
-        }
-    }
+/**
+ * @brief writes everything main() reports for one pair of matrices, in order
+ * @param matrixA the first matrix
+ * @param matrixB the second matrix
+ * @param out the stream for results
+ * @param err the stream for errors
+ */
+void writeReport(const Matrix &matrixA, const Matrix &matrixB, std::ostream &out, std::ostream &err)
+{
+    // the sum buffer is kept per thread and reused from report to report.
+    // it is moved out while in use, since a thread waiting on the pool
+    // inside this function may start another report.
+    thread_local Matrix spareSum(0);
+    Matrix sumMatrix = std::move(spareSum);
 
-    // read matrix B
-    for (int i = 0; i < n; ++i)
-    {
-        for (int j = 0; j < n; ++j)
-        {
-            if (!(inFile >> matrixB[i][j]))
-            {
-                std::cerr << "Error: Failed to read element for Matrix B at [" << i << "][" << j << "]" << std::endl;
-                inFile.close();
-                return false;
-            }
-        }
-    }
+    out << "Matrices loaded\n";
+    printMatrix(matrixA, "Matrix A:", out);
+    printMatrix(matrixB, "Matrix B:", out);
 
-    inFile.close();
-    return true;
+    out << "\nMatrix Addition\n";
+    add_into(sumMatrix, matrixA, matrixB);
+    printMatrix(sumMatrix, "Result (A + B):", out);
+
+    // the same product step as a single input: the storage format sampled
+    // from each matrix, and overflow reported on err
+    out << "\nMatrix Multiplication\n";
+    writeProduct(AdaptiveMatrix(matrixA), AdaptiveMatrix(matrixB), out, err);
+
+    out << "\nDiagonal Sums (Matrix A)\n";
+    sumDiagonals(matrixA, out, err);
+
+    out << "\nSwapping Rows 0 and 1 of Matrix A\n";
+    Matrix matrixA_copy_rows = matrixA;
+    swapRows(matrixA_copy_rows, 0, 1, err);
+    printMatrix(matrixA_copy_rows, "Matrix A after row swap:", out);
+
+    out << "\nSwapping Columns 1 and 2 of Matrix B\n";
+    Matrix matrixB_copy_cols = matrixB;
+    swapCols(matrixB_copy_cols, 1, 2, err);
+    printMatrix(matrixB_copy_cols, "Matrix B after column swap:", out);
+
+    out << "\nUpdating Element (2, 2) in Matrix A to 99\n";
+    Matrix matrixA_copy_update = matrixA;
+    updateElement(matrixA_copy_update, 2, 2, 99, err);
+    printMatrix(matrixA_copy_update, "Matrix A after update:", out);
+
+    spareSum = std::move(sumMatrix);
 }
 
 /**
  * @brief prints a matrix with aligned columns
  * @param matrix the matrix to print
  * @param label a label to print before the matrix
+ * @param out the stream to print to
  */
-void printMatrix(const Matrix &matrix, const std::string &label)
+void printMatrix(const Matrix &matrix, const std::string &label, std::ostream &out)
 {
-    std::cout << label << std::endl;
-    if (matrix.empty() || matrix[0].empty())
+    MatrixWriter writer(out);
+    writer.write(label).write("\n");
+    if (matrix.get_size() == 0)
     {
-        std::cout << "[Empty Matrix]" << std::endl;
+        writer.write("[Empty Matrix]\n");
         return;
     }
 
-    int n = matrix.size();
-    int fieldWidth = 6;
-
-    for (int i = 0; i < n; ++i)
-    {
-        for (int j = 0; j < n; ++j)
-        {
-            std::cout << std::setw(fieldWidth) << matrix[i][j];
-        }
-        std::cout << std::endl;
-    }
-    std::cout << std::endl;
+    writer.write(matrix).write("\n");
 }
 
 /**
@@ -168,80 +267,77 @@ void printMatrix(const Matrix &matrix, const std::string &label)
  */
 Matrix addMatrices(const Matrix &matrixA, const Matrix &matrixB)
 {
-    if (matrixA.empty() || matrixA.size() != matrixB.size() || matrixA[0].size() != matrixB[0].size())
+    if (matrixA.get_size() == 0 || matrixA.get_size() != matrixB.get_size())
     {
         throw std::runtime_error("Matrix dimensions must match for addition");
     }
 
-    int n = matrixA.size();
-    Matrix result(n, std::vector<int>(n));
-
-    for (int i = 0; i < n; ++i)
-    {
-        for (int j = 0; j < n; ++j)
-        {
-            result[i][j] = matrixA[i][j] + matrixB[i][j];
-        }
-    }
-    return result;
+    return matrixA + matrixB;
 }
 
 /**
- * @brief multiplies two matrices
+ * @brief multiplies two matrices with the kernel their storage formats call for, warning if an element of the product overflows int
  * @param matrixA the first matrix
  * @param matrixB the second matrix
- * @return the resulting product matrix. throws runtime_error if dimensions are incompatible
+ * @param err the stream to report overflow to
+ * @return the resulting product matrix, with overflowed elements wrapped. throws runtime_error if dimensions are incompatible
  */
-Matrix multiplyMatrices(const Matrix &matrixA, const Matrix &matrixB)
+Matrix multiplyMatrices(const AdaptiveMatrix &matrixA, const AdaptiveMatrix &matrixB, std::ostream &err)
 {
-    if (matrixA.empty() || matrixA[0].size() != matrixB.size())
+    if (matrixA.get_size() == 0 || matrixA.get_size() != matrixB.get_size())
     {
         throw std::runtime_error("Matrix dimensions incompatible for multiplication (A's cols must equal B's rows)");
     }
 
-    int n = matrixA.size();    // rows in A and Result
-    int m = matrixB[0].size(); // columns in B and Result
-    int p = matrixB.size();    // columns in A and Rows in B
-
-    Matrix result(n, std::vector<int>(m, 0)); // initialize result with zeros
-
-    for (int i = 0; i < n; ++i)
-    { // iterate rows of Result (and A)
-        for (int j = 0; j < m; ++j)
-        { // Iterate columns of Result (and B)
-            for (int k = 0; k < p; ++k)
-            { // iterate common dimension
-                result[i][j] += matrixA[i][k] * matrixB[k][j];
-            }
-        }
+    // the sparse kernels wrap without checking, which is exact while no sum
+    // can leave int's range; past that the product is checked densely
+    const bool sparse = matrixA.format() != StorageFormat::dense || matrixB.format() != StorageFormat::dense;
+    if (sparse && product_fits_int(matrixA, matrixB))
+    {
+        return (matrixA * matrixB).to_dense();
+    }
+
+    bool overflow = false;
+    Matrix product = multiply<Accumulation::checked>(matrixA.to_dense(), matrixB.to_dense(), &overflow);
+    if (overflow)
+    {
+        err << "Warning: Matrix multiplication overflowed int; affected elements are wrapped" << std::endl;
     }
-    return result;
+    return product;
+}
+
+/**
+ * @brief prints the product of two matrices, the step both single-file and batch runs use
+ * @param matrixA the first matrix
+ * @param matrixB the second matrix
+ * @param out the stream to print the product to
+ * @param err the stream to report overflow to
+ */
+void writeProduct(const AdaptiveMatrix &matrixA, const AdaptiveMatrix &matrixB, std::ostream &out, std::ostream &err)
+{
+    printMatrix(multiplyMatrices(matrixA, matrixB, err), "Result (A * B):", out);
 }
 
 /**
  * @brief calculates and prints the sum of main and secondary diagonals
  * @param matrix the input matrix
+ * @param out the stream to print the sums to
+ * @param err the stream to report errors to
  */
-void sumDiagonals(const Matrix &matrix)
+void sumDiagonals(const Matrix &matrix, std::ostream &out, std::ostream &err)
 {
-    if (matrix.empty() || matrix.size() != matrix[0].size())
+    if (matrix.get_size() == 0)
     {
-        std::cerr << "Error: Matrix must be square to calculate diagonals" << std::endl;
+        err << "Error: Matrix must be square to calculate diagonals" << std::endl;
         return;
     }
 
-    int n = matrix.size();
-    long long mainDiagonalSum = 0;
-    long long secondaryDiagonalSum = 0;
+    // accumulated in 64 bits, so the sums cannot overflow
+    long long mainDiagonalSum = sum_diagonal_major<Accumulation::widen>(matrix);
+    long long secondaryDiagonalSum = sum_diagonal_minor<Accumulation::widen>(matrix);
 
-    for (int i = 0; i < n; ++i)
-    {
-        mainDiagonalSum += matrix[i][i];
-        secondaryDiagonalSum += matrix[i][n - 1 - i];
-    }
-
-    std::cout << "Sum of main diagonal elements: " << mainDiagonalSum << std::endl;
-    std::cout << "Sum of secondary diagonal elements: " << secondaryDiagonalSum << std::endl;
+    out << "Sum of main diagonal elements: " << mainDiagonalSum << std::endl;
+    out << "Sum of secondary diagonal elements: " << secondaryDiagonalSum << std::endl;
 }
 
 /**
@@ -249,26 +345,26 @@ void sumDiagonals(const Matrix &matrix)
  * @param matrix the matrix to modify
  * @param row1 index of the first row
  * @param row2 index of the second row
+ * @param err the stream to report errors to
  */
-void swapRows(Matrix &matrix, int row1, int row2)
+void swapRows(Matrix &matrix, int row1, int row2, std::ostream &err)
 {
-    if (matrix.empty())
+    if (matrix.get_size() == 0)
     {
-        std::cerr << "Error: Cannot swap rows in an empty matrix" << std::endl;
+        err << "Error: Cannot swap rows in an empty matrix" << std::endl;
         return;
     }
-    int n = matrix.size();
+    int n = matrix.get_size();
     if (row1 < 0 || row1 >= n || row2 < 0 || row2 >= n)
     {
-        std::cerr << "Error: Row index out of bounds (" << row1 << ", " << row2 << "). Valid range is 0 to " << n - 1 << std::endl;
+        err << "Error: Row index out of bounds (" << row1 << ", " << row2 << "). Valid range is 0 to " << n - 1 << std::endl;
         return;
     }
 
     if (row1 == row2)
         return; // don't swap if the indices are the same
 
-    // std::vector supports efficient swapping
-    std::swap(matrix[row1], matrix[row2]);
+    matrix.swap_rows(row1, row2);
 }
 
 /**
@@ -276,30 +372,27 @@ void swapRows(Matrix &matrix, int row1, int row2)
  * @param matrix the matrix to modify
  * @param col1 index of the first column
  * @param col2 index of the second column
+ * @param err the stream to report errors to
  */
-void swapCols(Matrix &matrix, int col1, int col2)
+void swapCols(Matrix &matrix, int col1, int col2, std::ostream &err)
 {
-    if (matrix.empty() || matrix[0].empty())
+    if (matrix.get_size() == 0)
     {
-        std::cerr << "Error: Cannot swap columns in an empty matrix" << std::endl;
+        err << "Error: Cannot swap columns in an empty matrix" << std::endl;
         return;
     }
-    int n = matrix.size();
-    int m = matrix[0].size();
+    int m = matrix.get_size();
 
     if (col1 < 0 || col1 >= m || col2 < 0 || col2 >= m)
     {
-        std::cerr << "Error: Column index out of bounds (" << col1 << ", " << col2 << "). Valid range is 0 to " << m - 1 << std::endl;
+        err << "Error: Column index out of bounds (" << col1 << ", " << col2 << "). Valid range is 0 to " << m - 1 << std::endl;
         return;
     }
 
     if (col1 == col2)
         return; // don't swap
 
-    for (int i = 0; i < n; ++i)
-    { // Iterate through rows
-        std::swap(matrix[i][col1], matrix[i][col2]);
-    }
+    matrix.swap_cols(col1, col2);
 }
 
 /**
@@ -308,23 +401,24 @@ void swapCols(Matrix &matrix, int col1, int col2)
  * @param row row index of the element
  * @param col column index of the element
  * @param newValue the new value for the element
+ * @param err the stream to report errors to
  */
-void updateElement(Matrix &matrix, int row, int col, int newValue)
+void updateElement(Matrix &matrix, int row, int col, int newValue, std::ostream &err)
 {
-    if (matrix.empty() || matrix[0].empty())
+    if (matrix.get_size() == 0)
     {
-        std::cerr << "Error: Cannot update element in an empty matrix" << std::endl;
+        err << "Error: Cannot update element in an empty matrix" << std::endl;
         return;
     }
-    int n = matrix.size();
-    int m = matrix[0].size();
+    int n = matrix.get_size();
+    int m = n;
 
     if (row < 0 || row >= n || col < 0 || col >= m)
     {
-        std::cerr << "Error: Index (" << row << ", " << col << ") out of bounds. Valid row range 0 to "
+        err << "Error: Index (" << row << ", " << col << ") out of bounds. Valid row range 0 to "
                   << n - 1 << ", valid col range 0 to " << m - 1 << std::endl;
         return;
     }
 
-    matrix[row][col] = newValue;
+    matrix.set_value(row, col, newValue);
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef __MAPPED_FILE_HPP__
+#define __MAPPED_FILE_HPP__
+
+#include <cstddef>
+#include <string>
+
+// read-only memory mapping of a whole file. parsers work straight on the
+// mapped pages, so the file is never copied into a user-space buffer and
+// the page cache is shared with every other reader of the file.
+class MappedFile {
+public:
+    // throws std::runtime_error("Could not open file <name>") if the file
+    // cannot be opened or mapped
+    explicit MappedFile(const std::string &filename);
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return data_; }
+    // the mapping is private, so writes land in this process's pages only
+    char *data() { return data_; }
+    std::size_t size() const { return size_; }
+    const char *begin() const { return data_; }
+    const char *end() const { return data_ + size_; }
+
+private:
+    void unmap();
+
+    char *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+#endif // __MAPPED_FILE_HPP__
@@ -1,17 +1,392 @@
 #include "matrix.hpp"
+#include "gemm.hpp"
+#include "matrix_writer.hpp"
+#include "strassen.hpp"
+#include "thread_pool.hpp"
+#include "wrapping.hpp"
 
-// implementation of functions declared in matrix.hpp goes here
-// function definitions for a class have their names prefixed with
-// the class name and "::"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
 
-// e.g. for the constructor:
+namespace {
 
-Matrix::Matrix(size_t N) {
-    // initialize an empty NxN matrix
+// zero-filled, cache-line aligned block of `count` elements
+template <typename T>
+std::shared_ptr<T> allocate_panel(std::size_t count) {
+    AlignedAllocator<T> alloc;
+    T *p = alloc.allocate(std::max<std::size_t>(count, 1));
+    std::fill(p, p + count, T());
+    return std::shared_ptr<T>(p, [alloc](T *q) mutable { alloc.deallocate(q, 0); });
 }
 
-// e.g. for a member function:
+// rows handed to one pool task by the diagonal sums
+constexpr std::size_t kDiagonalTaskRows = 4096;
 
-void Matrix::print_matrix() const {
-    // print out the matrix
+// sum of row(i)[column(i)] over all rows, split into row chunks on the pool
+template <typename T, typename Column>
+T sum_diagonal(const BasicMatrix<T> &m, std::size_t n, Column column) {
+    const std::size_t chunks = (n + kDiagonalTaskRows - 1) / kDiagonalTaskRows;
+    std::vector<T> partial(chunks, T());
+    default_thread_pool().parallel_for(chunks, [&](std::size_t chunk) {
+        const std::size_t end = std::min(n, (chunk + 1) * kDiagonalTaskRows);
+        T sum = T();
+        for (std::size_t i = chunk * kDiagonalTaskRows; i < end; ++i) {
+            sum = wrapping_add(sum, m.row(i)[m.col_index(column(i))]);
+        }
+        partial[chunk] = sum;
+    }, 1);
+
+    T sum = T();
+    for (T value : partial) {
+        sum = wrapping_add(sum, value);
+    }
+    return sum;
+}
+
+// materialize the element-wise sum of an operand's terms
+template <typename T>
+BasicMatrix<T> sum_terms(const BasicGemmOperand<T> &operand, std::size_t n) {
+    BasicMatrix<T> result(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        T *dst = result.row(i);
+        for (std::size_t t = 0; t < operand.count; ++t) {
+            const T *src = operand.terms[t].row(i);
+            for (std::size_t j = 0; j < n; ++j) {
+                dst[j] = wrapping_add(dst[j], src[j]);
+            }
+        }
+    }
+    return result;
+}
+
+// true if any term of the operand reads m's storage
+template <typename T>
+bool operand_overlaps(const BasicGemmOperand<T> &operand, const BasicMatrix<T> &m) {
+    const BasicConstMatrixView<T> own = m.view();
+    for (std::size_t t = 0; t < operand.count; ++t) {
+        if (operand.terms[t].rows == own.rows) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// target = A * B through the blocked gemm
+template <typename T>
+void multiply_product(const BasicGemmOperand<T> &a, const BasicGemmOperand<T> &b, BasicMatrix<T> &target,
+                      std::size_t n) {
+    const BasicMatrixView<T> c = target.view();
+    for (std::size_t i = 0; i < n; ++i) {
+        std::fill(c.row(i), c.row(i) + n, T());
+    }
+    gemm(a, b, c, n, n, n);
+}
+
+// the int form switches to Strassen above the crossover (its kernels are
+// int only)
+void multiply_product(const GemmOperand &a, const GemmOperand &b, Matrix &target, std::size_t n) {
+    if (n <= strassen_crossover()) {
+        multiply_product<int>(a, b, target, n);
+        return;
+    }
+    // the recursion revisits its operands many times, so sums are
+    // materialized once up front rather than folded into every pack
+    const Matrix a_dense = a.count > 1 ? sum_terms(a, n) : Matrix(0);
+    const Matrix b_dense = b.count > 1 ? sum_terms(b, n) : Matrix(0);
+    strassen_multiply(a.count > 1 ? a_dense.view() : a.terms[0],
+                      b.count > 1 ? b_dense.view() : b.terms[0], target.view(), n);
+}
+
+} // namespace
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(std::size_t N)
+    : size_(N), stride_(stride_for(N)), storage_(N == 0 ? empty_storage() : allocate_storage(N, stride_)) {}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(std::vector<std::vector<T>> nums) : BasicMatrix(nums.size()) {
+    for (std::size_t i = 0; i < size_; ++i) {
+        if (nums[i].size() != size_) {
+            throw std::invalid_argument("Matrix rows must all have length " + std::to_string(size_));
+        }
+        std::copy(nums[i].begin(), nums[i].end(), row(i));
+    }
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(BasicMatrix &&other) noexcept
+    : size_(other.size_), stride_(other.stride_), storage_(std::move(other.storage_)) {
+    other.size_ = 0;
+    other.stride_ = 0;
+    other.storage_ = empty_storage();
+}
+
+template <typename T>
+BasicMatrix<T> &BasicMatrix<T>::operator=(BasicMatrix &&other) noexcept {
+    if (this != &other) {
+        size_ = other.size_;
+        stride_ = other.stride_;
+        storage_ = std::move(other.storage_);
+        other.size_ = 0;
+        other.stride_ = 0;
+        other.storage_ = empty_storage();
+    }
+    return *this;
+}
+
+template <typename T>
+std::shared_ptr<typename BasicMatrix<T>::Storage> BasicMatrix<T>::empty_storage() {
+    static const std::shared_ptr<Storage> empty = std::make_shared<Storage>();
+    return empty;
+}
+
+template <typename T>
+std::size_t BasicMatrix<T>::stride_for(std::size_t N) {
+    // round the row length up to a whole number of cache lines
+    const std::size_t per_line = kCacheLine / sizeof(T);
+    return (N + per_line - 1) / per_line * per_line;
+}
+
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::wrap(std::shared_ptr<void> owner, T *data, std::size_t N) {
+    if (reinterpret_cast<std::uintptr_t>(data) % kCacheLine != 0) {
+        throw std::invalid_argument("wrapped matrix data must be cache-line aligned");
+    }
+
+    BasicMatrix m(0);
+    if (N == 0) {
+        return m;
+    }
+    m.size_ = N;
+    m.stride_ = stride_for(N);
+    m.storage_ = std::make_shared<Storage>();
+    Storage &storage = *m.storage_;
+    const std::size_t panels = (N + kPanelRows - 1) / kPanelRows;
+    storage.rows.resize(N);
+    storage.panel_of.resize(N);
+    for (std::size_t p = 0; p < panels; ++p) {
+        // each panel shares ownership of the whole block with the owner
+        T *base = data + p * kPanelRows * m.stride_;
+        storage.panels.emplace_back(owner, base);
+        const std::size_t rows = std::min(kPanelRows, N - p * kPanelRows);
+        for (std::size_t r = 0; r < rows; ++r) {
+            storage.rows[p * kPanelRows + r] = base + r * m.stride_;
+            storage.panel_of[p * kPanelRows + r] = static_cast<std::uint32_t>(p);
+        }
+    }
+    return m;
 }
+
+template <typename T>
+std::shared_ptr<typename BasicMatrix<T>::Storage> BasicMatrix<T>::allocate_storage(std::size_t N, std::size_t stride) {
+    auto storage = std::make_shared<Storage>();
+    const std::size_t panels = (N + kPanelRows - 1) / kPanelRows;
+    storage->panels.reserve(panels);
+    storage->rows.resize(N);
+    storage->panel_of.resize(N);
+    for (std::size_t p = 0; p < panels; ++p) {
+        const std::size_t first = p * kPanelRows;
+        const std::size_t rows = std::min(kPanelRows, N - first);
+        storage->panels.push_back(allocate_panel<T>(rows * stride));
+        T *base = storage->panels.back().get();
+        for (std::size_t r = 0; r < rows; ++r) {
+            storage->rows[first + r] = base + r * stride;
+            storage->panel_of[first + r] = static_cast<std::uint32_t>(p);
+        }
+    }
+    return storage;
+}
+
+template <typename T>
+void BasicMatrix<T>::make_table_private() {
+    // the row table is shared by every snapshot, so give this matrix its own
+    // before pointing any row somewhere new
+    if (storage_.use_count() != 1) {
+        storage_ = std::make_shared<Storage>(*storage_);
+    }
+}
+
+template <typename T>
+void BasicMatrix<T>::copy_panel(std::size_t panel) {
+    make_table_private();
+    std::shared_ptr<T> &slot = storage_->panels[panel];
+    if (slot.use_count() == 1) {
+        return;
+    }
+
+    // row swaps may have scattered the panel's rows across the table, so
+    // repoint every row that lives in it (one scan of panel_of)
+    const std::size_t rows = std::min(kPanelRows, size_ - panel * kPanelRows);
+    std::shared_ptr<T> copy = allocate_panel<T>(rows * stride_);
+    std::copy(slot.get(), slot.get() + rows * stride_, copy.get());
+    for (std::size_t i = 0; i < size_; ++i) {
+        if (storage_->panel_of[i] == panel) {
+            storage_->rows[i] = copy.get() + (storage_->rows[i] - slot.get());
+        }
+    }
+    slot = std::move(copy);
+}
+
+template <typename T>
+void BasicMatrix<T>::materialize() {
+    if (storage_->col_perm.empty()) {
+        return;
+    }
+
+    // gather every row through the column permutation into fresh panels,
+    // laid out in logical row order
+    std::shared_ptr<Storage> gathered = allocate_storage(size_, stride_);
+    const Storage &src = *storage_;
+    default_thread_pool().parallel_for(size_, [&](std::size_t i) {
+        const T *from = src.rows[i];
+        T *to = gathered->rows[i];
+        for (std::size_t j = 0; j < size_; ++j) {
+            to[j] = from[src.col_perm[j]];
+        }
+    }, std::max<std::size_t>(1, kElementwiseTaskInts / stride_));
+    storage_ = std::move(gathered);
+}
+
+template <typename T>
+BasicMatrixView<T> BasicMatrix<T>::view() {
+    materialize();
+    for (std::size_t p = 0; p < storage_->panels.size(); ++p) {
+        if (storage_.use_count() != 1 || storage_->panels[p].use_count() != 1) {
+            copy_panel(p);
+        }
+    }
+    return BasicMatrixView<T>{nullptr, 0, storage_->rows.data(), 0};
+}
+
+template <typename T>
+bool BasicMatrix<T>::shares_storage_with(const BasicMatrix &other) const {
+    if (size_ == 0 || other.size_ == 0) {
+        return false;
+    }
+    if (storage_ == other.storage_) {
+        return true;
+    }
+    for (const auto &mine : storage_->panels) {
+        for (const auto &theirs : other.storage_->panels) {
+            if (mine == theirs) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+template <typename T>
+void multiply_into(BasicMatrix<T> &dst, const BasicGemmOperand<T> &a, const BasicGemmOperand<T> &b, std::size_t n) {
+    // the spare is moved out while in use, so a nested call on this thread
+    // (from a task it runs while waiting on the pool) gets its own buffer
+    thread_local BasicMatrix<T> spare(0);
+
+    const bool aliased = operand_overlaps(a, dst) || operand_overlaps(b, dst);
+    BasicMatrix<T> target = aliased ? std::move(spare) : std::move(dst);
+    if (target.get_size() != static_cast<int>(n)) {
+        target = BasicMatrix<T>(n);
+    }
+
+    multiply_product(a, b, target, n);
+
+    if (aliased) {
+        spare = std::move(dst);
+    }
+    dst = std::move(target);
+}
+
+template <typename T>
+void BasicMatrix<T>::check_index(std::size_t i, std::size_t j) const {
+    if (i >= size_ || j >= size_) {
+        throw std::out_of_range("Matrix index (" + std::to_string(i) + ", " + std::to_string(j) +
+                                ") out of bounds for size " + std::to_string(size_));
+    }
+}
+
+template <typename T>
+void BasicMatrix<T>::set_value(std::size_t i, std::size_t j, T n) {
+    check_index(i, j);
+    // writes through the permutation, so a pending column swap stays pending
+    make_row_writable(i);
+    storage_->rows[i][col_index(j)] = n;
+}
+
+template <typename T>
+T BasicMatrix<T>::get_value(std::size_t i, std::size_t j) const {
+    check_index(i, j);
+    return row(i)[col_index(j)];
+}
+
+template <typename T>
+int BasicMatrix<T>::get_size() const {
+    return static_cast<int>(size_);
+}
+
+template <typename T>
+T BasicMatrix<T>::sum_diagonal_major() const {
+    return sum_diagonal(*this, size_, [](std::size_t i) { return i; });
+}
+
+template <typename T>
+T BasicMatrix<T>::sum_diagonal_minor() const {
+    const std::size_t last = size_ - 1;
+    return sum_diagonal(*this, size_, [last](std::size_t i) { return last - i; });
+}
+
+template <typename T>
+void BasicMatrix<T>::swap_rows(std::size_t r1, std::size_t r2) {
+    check_index(r1, r2);
+    if (r1 == r2) {
+        return;
+    }
+    make_table_private();
+    std::swap(storage_->rows[r1], storage_->rows[r2]);
+    std::swap(storage_->panel_of[r1], storage_->panel_of[r2]);
+}
+
+template <typename T>
+void BasicMatrix<T>::swap_cols(std::size_t c1, std::size_t c2) {
+    check_index(c1, c2);
+    if (c1 == c2) {
+        return;
+    }
+    make_table_private();
+    std::vector<std::uint32_t> &perm = storage_->col_perm;
+    if (perm.empty()) {
+        perm.resize(size_);
+        for (std::size_t j = 0; j < size_; ++j) {
+            perm[j] = static_cast<std::uint32_t>(j);
+        }
+    }
+    std::swap(perm[c1], perm[c2]);
+}
+
+template <typename T>
+void BasicMatrix<T>::print_matrix() const {
+    write_matrix(std::cout, *this);
+}
+
+template class BasicMatrix<std::int8_t>;
+template class BasicMatrix<std::int16_t>;
+template class BasicMatrix<int>;
+template class BasicMatrix<std::int64_t>;
+template class BasicMatrix<float>;
+template class BasicMatrix<double>;
+
+template void multiply_into(BasicMatrix<std::int8_t> &, const BasicGemmOperand<std::int8_t> &,
+                            const BasicGemmOperand<std::int8_t> &, std::size_t);
+template void multiply_into(BasicMatrix<std::int16_t> &, const BasicGemmOperand<std::int16_t> &,
+                            const BasicGemmOperand<std::int16_t> &, std::size_t);
+template void multiply_into(BasicMatrix<int> &, const BasicGemmOperand<int> &, const BasicGemmOperand<int> &,
+                            std::size_t);
+template void multiply_into(BasicMatrix<std::int64_t> &, const BasicGemmOperand<std::int64_t> &,
+                            const BasicGemmOperand<std::int64_t> &, std::size_t);
+template void multiply_into(BasicMatrix<float> &, const BasicGemmOperand<float> &, const BasicGemmOperand<float> &,
+                            std::size_t);
+template void multiply_into(BasicMatrix<double> &, const BasicGemmOperand<double> &,
+                            const BasicGemmOperand<double> &, std::size_t);
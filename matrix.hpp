@@ -1,24 +1,373 @@
-#ifndef __MATRIX_HPP__
-#define __MATRIX_HPP__
-
-#include <cstdint>
-#include <vector>
-
-class Matrix {
-public:
-    Matrix(std::size_t N);
-    Matrix(std::vector<std::vector<int>> nums);
-
-    Matrix operator+(const Matrix &rhs) const;
-    Matrix operator*(const Matrix &rhs) const;
-    void set_value(std::size_t i, std::size_t j, int n);
-    int get_value(std::size_t i, std::size_t j) const;
-    int get_size() const;
-    int sum_diagonal_major() const;
-    int sum_diagonal_minor() const;
-    void swap_rows(std::size_t r1, std::size_t r2);
-    void swap_cols(std::size_t c1, std::size_t c2);
-    void print_matrix() const;
-};
-
-#endif // __MATRIX_HPP__
\ No newline at end of file
+#ifndef __MATRIX_HPP__
+#define __MATRIX_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+#include "wrapping.hpp"
+
+// ints of output handed to one pool task by element-wise operations; the
+// work per element is tiny, so anything smaller runs on the calling thread
+constexpr std::size_t kElementwiseTaskInts = 16 * 1024;
+
+// base of everything that can appear in a Matrix expression. A + B does not
+// compute anything; it builds a MatrixSum node that is evaluated in a single
+// fused pass when it is assigned to a Matrix (or packed by a multiply).
+//
+// every expression E provides:
+//   value_type                                element type
+//   std::size_t size() const                  dimension N
+//   value_type get_value(i, j) const          bounds-checked element
+//   row_reader(i) const                       object whose [j] yields E(i, j)
+//   bool collect_terms(BasicGemmOperand<value_type> &) const
+//                                             flatten a sum of matrices into
+//                                             gemm terms (false if it cannot)
+template <typename E>
+struct MatrixExpr {
+    const E &derived() const { return static_cast<const E &>(*this); }
+    int get_size() const { return static_cast<int>(derived().size()); }
+};
+
+// square NxN matrix of T stored row-major. rows are grouped into panels of
+// kPanelRows rows, each one contiguous, cache-line aligned buffer; every row
+// starts on a cache line, padded out to stride() elements with zeros.
+//
+// copies are copy-on-write snapshots: they share the panels (and the table
+// of row pointers) and cost O(1). the first write through a non-const row(),
+// view() or set_value() copies only the panels it touches.
+//
+// swap_rows() and swap_cols() are O(1): a row swap exchanges two entries of
+// the row table, which every kernel reads rows through anyway, and a column
+// swap is recorded in a column permutation. pending column swaps are applied
+// in one gather pass by materialize(), which the non-const row() and view()
+// call first; until then get_value() and expressions read through the
+// permutation.
+//
+// the members are defined in matrix.cpp and instantiated for int8_t,
+// int16_t, int, int64_t, float and double. integer arithmetic wraps like
+// the element type.
+template <typename T>
+class BasicMatrix : public MatrixExpr<BasicMatrix<T>> {
+public:
+    using value_type = T;
+
+    BasicMatrix(std::size_t N);
+    BasicMatrix(std::vector<std::vector<T>> nums);
+
+    // copies share storage until one side writes; moves steal the storage
+    // and leave the source as an empty 0x0 matrix
+    BasicMatrix(const BasicMatrix &other) = default;
+    BasicMatrix(BasicMatrix &&other) noexcept;
+    BasicMatrix &operator=(const BasicMatrix &other) = default;
+    BasicMatrix &operator=(BasicMatrix &&other) noexcept;
+
+    // evaluate an expression such as A + B + C in one pass over the rows
+    template <typename E>
+    BasicMatrix(const MatrixExpr<E> &expr) : BasicMatrix(expr.derived().size()) {
+        assign(expr.derived());
+    }
+
+    template <typename E>
+    BasicMatrix &operator=(const MatrixExpr<E> &expr) {
+        // element-wise expressions read and write the same (i, j), so
+        // evaluating in place is safe even when *this is an operand
+        if (expr.derived().size() != size_) {
+            *this = BasicMatrix(expr.derived().size());
+        }
+        assign(expr.derived());
+        return *this;
+    }
+
+    // in-place forms: += adds an expression into the existing buffer and *=
+    // multiplies through a per-thread spare buffer, so neither allocates once
+    // the buffers have reached their working size
+    template <typename E>
+    BasicMatrix &operator+=(const MatrixExpr<E> &expr);
+    template <typename E>
+    BasicMatrix &operator*=(const MatrixExpr<E> &rhs);
+
+    void set_value(std::size_t i, std::size_t j, T n);
+    T get_value(std::size_t i, std::size_t j) const;
+    int get_size() const;
+    T sum_diagonal_major() const;
+    T sum_diagonal_minor() const;
+    void swap_rows(std::size_t r1, std::size_t r2);
+    void swap_cols(std::size_t c1, std::size_t c2);
+    void print_matrix() const;
+
+    static constexpr std::size_t kPanelRows = 64;
+
+    // row stride used for an N x N matrix: N rounded up to whole cache lines
+    static std::size_t stride_for(std::size_t N);
+
+    // matrix whose rows live in memory owned by someone else (a file
+    // mapping, say), without copying. data must be cache-line aligned, hold
+    // N rows of stride_for(N) elements with zeroed padding, and stay valid
+    // while owner is alive. writes copy the touched panel out first, unless
+    // this matrix holds the only reference to it. throws
+    // std::invalid_argument if the alignment is wrong.
+    static BasicMatrix wrap(std::shared_ptr<void> owner, T *data, std::size_t N);
+
+    // unchecked access to the first element of row i. the non-const form
+    // applies pending column swaps and makes the row's panel private to this
+    // matrix; the const form indexes physical columns (see col_index()).
+    T *row(std::size_t i) {
+        if (!storage_->col_perm.empty()) {
+            materialize();
+        }
+        make_row_writable(i);
+        return storage_->rows[i];
+    }
+    const T *row(std::size_t i) const { return storage_->rows[i]; }
+
+    // physical column that logical column j currently lives in
+    std::size_t col_index(std::size_t j) const {
+        return storage_->col_perm.empty() ? j : storage_->col_perm[j];
+    }
+    bool has_column_permutation() const { return !storage_->col_perm.empty(); }
+    // apply pending column swaps in a single gather pass
+    void materialize();
+    // number of elements from the start of a row to the start of the next
+    // row in the same panel
+    std::size_t stride() const { return stride_; }
+
+    // views address rows through the row table; the non-const view applies
+    // pending column swaps and makes the whole matrix private first, so it is
+    // safe to write from any thread. like the const row(), the const view
+    // indexes physical columns.
+    BasicConstMatrixView<T> view() const { return BasicConstMatrixView<T>{nullptr, 0, storage_->rows.data(), 0}; }
+    BasicMatrixView<T> view();
+
+    // true if the two matrices currently share any storage
+    bool shares_storage_with(const BasicMatrix &other) const;
+
+    // reads logical columns of one row, through the column permutation if
+    // there is one
+    struct RowReader {
+        const T *row;
+        const std::uint32_t *cols;
+        T operator[](std::size_t j) const { return cols ? row[cols[j]] : row[j]; }
+    };
+
+    // expression interface
+    std::size_t size() const { return size_; }
+    RowReader row_reader(std::size_t i) const {
+        return RowReader{row(i), storage_->col_perm.empty() ? nullptr : storage_->col_perm.data()};
+    }
+    // gemm reads physical columns, so a matrix with pending column swaps is
+    // left for the caller to materialize
+    bool collect_terms(BasicGemmOperand<T> &operand) const {
+        return !has_column_permutation() && operand.add_term(view());
+    }
+
+private:
+    template <typename E>
+    void assign(const E &expr);
+    template <typename E>
+    void accumulate(const E &expr);
+
+    void check_index(std::size_t i, std::size_t j) const;
+
+    // panels, the row table and the column permutation, shared between
+    // snapshots. rows[i] is the start of logical row i, which lives in
+    // panels[panel_of[i]]; col_perm is empty when no columns are swapped.
+    struct Storage {
+        std::vector<std::shared_ptr<T>> panels;
+        std::vector<T *> rows;
+        std::vector<std::uint32_t> panel_of;
+        std::vector<std::uint32_t> col_perm;
+    };
+
+    static std::shared_ptr<Storage> empty_storage();
+    // fresh storage for an N x N matrix with rows in panel order
+    static std::shared_ptr<Storage> allocate_storage(std::size_t N, std::size_t stride);
+
+    void make_row_writable(std::size_t i) {
+        if (storage_.use_count() != 1 || storage_->panels[storage_->panel_of[i]].use_count() != 1) {
+            copy_panel(storage_->panel_of[i]);
+        }
+    }
+    // give this matrix its own row table, then its own copy of one panel
+    void make_table_private();
+    void copy_panel(std::size_t panel);
+
+    std::size_t size_;
+    std::size_t stride_;
+    std::shared_ptr<Storage> storage_;
+};
+
+using Matrix = BasicMatrix<int>;
+
+template <typename T>
+struct is_basic_matrix : std::false_type {};
+template <typename T>
+struct is_basic_matrix<BasicMatrix<T>> : std::true_type {};
+
+// how an expression node holds an operand: named matrices by reference,
+// temporaries (including temporary matrices) by value, so an expression
+// never outlives what it points to as long as its named operands live
+template <typename T>
+using expr_operand_t = std::conditional_t<std::is_lvalue_reference<T>::value,
+                                          std::conditional_t<is_basic_matrix<std::decay_t<T>>::value,
+                                                             const std::decay_t<T> &, std::decay_t<T>>,
+                                          std::decay_t<T>>;
+
+template <typename T>
+using is_matrix_expr = std::is_base_of<MatrixExpr<std::decay_t<T>>, std::decay_t<T>>;
+
+template <typename E>
+using expr_value_t = typename std::decay_t<E>::value_type;
+
+// lazy element-wise sum of two expressions of the same element type
+template <typename L, typename R>
+class MatrixSum : public MatrixExpr<MatrixSum<L, R>> {
+public:
+    using value_type = expr_value_t<L>;
+
+    template <typename LA, typename RA>
+    MatrixSum(LA &&lhs, RA &&rhs) : lhs_(std::forward<LA>(lhs)), rhs_(std::forward<RA>(rhs)) {
+        if (lhs_.size() != rhs_.size()) {
+            throw std::runtime_error("Matrix dimensions must match for addition");
+        }
+    }
+
+    template <typename LRow, typename RRow>
+    struct RowReader {
+        LRow lhs;
+        RRow rhs;
+        value_type operator[](std::size_t j) const { return wrapping_add<value_type>(lhs[j], rhs[j]); }
+    };
+
+    std::size_t size() const { return lhs_.size(); }
+    value_type get_value(std::size_t i, std::size_t j) const {
+        return wrapping_add<value_type>(lhs_.get_value(i, j), rhs_.get_value(i, j));
+    }
+
+    auto row_reader(std::size_t i) const {
+        using LRow = decltype(lhs_.row_reader(i));
+        using RRow = decltype(rhs_.row_reader(i));
+        return RowReader<LRow, RRow>{lhs_.row_reader(i), rhs_.row_reader(i)};
+    }
+
+    bool collect_terms(BasicGemmOperand<value_type> &operand) const {
+        return lhs_.collect_terms(operand) && rhs_.collect_terms(operand);
+    }
+
+private:
+    L lhs_;
+    R rhs_;
+};
+
+template <typename L, typename R,
+          typename = std::enable_if_t<is_matrix_expr<L>::value && is_matrix_expr<R>::value>,
+          typename = std::enable_if_t<std::is_same<expr_value_t<L>, expr_value_t<R>>::value>>
+MatrixSum<expr_operand_t<L>, expr_operand_t<R>> operator+(L &&lhs, R &&rhs) {
+    return MatrixSum<expr_operand_t<L>, expr_operand_t<R>>(std::forward<L>(lhs), std::forward<R>(rhs));
+}
+
+// dst = A * B where A and B are the element-wise sums held by the operands.
+// dst is reused if it already has the right size; if it is also one of the
+// operands the product goes through a per-thread spare buffer that is then
+// swapped in, so the spare is recycled instead of reallocated.
+template <typename T>
+void multiply_into(BasicMatrix<T> &dst, const BasicGemmOperand<T> &a, const BasicGemmOperand<T> &b, std::size_t n);
+
+// flatten both sides of a product into gemm operands, materializing a side
+// only if it has more terms than a GemmOperand can hold
+template <typename T, typename L, typename R>
+void multiply_into(BasicMatrix<T> &dst, const MatrixExpr<L> &lhs, const MatrixExpr<R> &rhs) {
+    static_assert(std::is_same<expr_value_t<L>, T>::value && std::is_same<expr_value_t<R>, T>::value,
+                  "both factors must have the destination's element type");
+    const std::size_t n = lhs.derived().size();
+    if (n != rhs.derived().size()) {
+        throw std::runtime_error("Matrix dimensions incompatible for multiplication");
+    }
+
+    BasicGemmOperand<T> a;
+    BasicGemmOperand<T> b;
+    const bool a_flat = lhs.derived().collect_terms(a);
+    const bool b_flat = rhs.derived().collect_terms(b);
+    if (a_flat && b_flat) {
+        multiply_into(dst, a, b, n);
+        return;
+    }
+    const BasicMatrix<T> a_dense = a_flat ? BasicMatrix<T>(0) : BasicMatrix<T>(lhs);
+    const BasicMatrix<T> b_dense = b_flat ? BasicMatrix<T>(0) : BasicMatrix<T>(rhs);
+    multiply_into(dst, a_flat ? a : BasicGemmOperand<T>(a_dense.view()),
+                  b_flat ? b : BasicGemmOperand<T>(b_dense.view()), n);
+}
+
+// products are evaluated eagerly, but sums feeding them are folded into the
+// packing of the operand instead of being materialized first
+template <typename L, typename R>
+BasicMatrix<expr_value_t<L>> operator*(const MatrixExpr<L> &lhs, const MatrixExpr<R> &rhs) {
+    BasicMatrix<expr_value_t<L>> result(0);
+    multiply_into(result, lhs, rhs);
+    return result;
+}
+
+// dst = a + b, written into dst's existing buffer when the size matches
+template <typename T, typename L, typename R>
+void add_into(BasicMatrix<T> &dst, const MatrixExpr<L> &a, const MatrixExpr<R> &b) {
+    dst = a.derived() + b.derived();
+}
+
+template <typename T>
+template <typename E>
+BasicMatrix<T> &BasicMatrix<T>::operator+=(const MatrixExpr<E> &expr) {
+    if (expr.derived().size() != size_) {
+        throw std::runtime_error("Matrix dimensions must match for addition");
+    }
+    accumulate(expr.derived());
+    return *this;
+}
+
+template <typename T>
+template <typename E>
+BasicMatrix<T> &BasicMatrix<T>::operator*=(const MatrixExpr<E> &rhs) {
+    multiply_into(*this, *this, rhs);
+    return *this;
+}
+
+template <typename T>
+template <typename E>
+void BasicMatrix<T>::assign(const E &expr) {
+    const BasicMatrixView<T> out = view();
+    default_thread_pool().parallel_for(size_, [&](std::size_t i) {
+        const auto src = expr.row_reader(i);
+        T *dst = out.row(i);
+        for (std::size_t j = 0; j < size_; ++j) {
+            dst[j] = src[j];
+        }
+    }, std::max<std::size_t>(1, kElementwiseTaskInts / std::max<std::size_t>(1, stride_)));
+}
+
+template <typename T>
+template <typename E>
+void BasicMatrix<T>::accumulate(const E &expr) {
+    const BasicMatrixView<T> out = view();
+    default_thread_pool().parallel_for(size_, [&](std::size_t i) {
+        const auto src = expr.row_reader(i);
+        T *dst = out.row(i);
+        for (std::size_t j = 0; j < size_; ++j) {
+            dst[j] += src[j];
+        }
+    }, std::max<std::size_t>(1, kElementwiseTaskInts / std::max<std::size_t>(1, stride_)));
+}
+
+extern template class BasicMatrix<std::int8_t>;
+extern template class BasicMatrix<std::int16_t>;
+extern template class BasicMatrix<int>;
+extern template class BasicMatrix<std::int64_t>;
+extern template class BasicMatrix<float>;
+extern template class BasicMatrix<double>;
+
+#endif // __MATRIX_HPP__
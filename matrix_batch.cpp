@@ -0,0 +1,247 @@
+#include "matrix_batch.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+#include "wrapping.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_HAVE_X86 1
+#endif
+
+namespace {
+
+constexpr std::size_t kLanes = MatrixBatch::kLanes;
+
+// c = a * b for one group of kLanes matrices (see MatrixBatch for the layout)
+using GroupMultiplyFn = void (*)(std::size_t n, const int *a, const int *b, int *c);
+
+void group_multiply_scalar(std::size_t n, const int *a, const int *b, int *c) {
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            int acc[kLanes] = {};
+            for (std::size_t k = 0; k < n; ++k) {
+                const int *x = a + (i * n + k) * kLanes;
+                const int *y = b + (k * n + j) * kLanes;
+                for (std::size_t l = 0; l < kLanes; ++l) {
+                    acc[l] = wrapping_madd(acc[l], x[l], y[l]);
+                }
+            }
+            int *dst = c + (i * n + j) * kLanes;
+            for (std::size_t l = 0; l < kLanes; ++l) {
+                dst[l] = acc[l];
+            }
+        }
+    }
+}
+
+#ifdef BATCH_HAVE_X86
+
+__attribute__((target("avx2"))) inline __m256i load8(const int *p) {
+    return _mm256_load_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+__attribute__((target("avx2"))) inline __m256i madd(__m256i acc, __m256i x, __m256i y) {
+    return _mm256_add_epi32(acc, _mm256_mullo_epi32(x, y));
+}
+
+__attribute__((target("avx512f"))) inline __m512i load16(const int *p) {
+    return _mm512_load_si512(p);
+}
+
+__attribute__((target("avx512f"))) inline __m512i madd(__m512i acc, __m512i x, __m512i y) {
+    return _mm512_add_epi32(acc, _mm512_mullo_epi32(x, y));
+}
+
+// two ymm per element; two output elements per pass share the A loads
+__attribute__((target("avx2")))
+void group_multiply_avx2(std::size_t n, const int *a, const int *b, int *c) {
+    for (std::size_t i = 0; i < n; ++i) {
+        std::size_t j = 0;
+        for (; j + 2 <= n; j += 2) {
+            __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+            __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+            for (std::size_t k = 0; k < n; ++k) {
+                const int *x = a + (i * n + k) * kLanes;
+                const int *y = b + (k * n + j) * kLanes;
+                const __m256i x0 = load8(x), x1 = load8(x + 8);
+                c00 = madd(c00, x0, load8(y));
+                c01 = madd(c01, x1, load8(y + 8));
+                c10 = madd(c10, x0, load8(y + kLanes));
+                c11 = madd(c11, x1, load8(y + kLanes + 8));
+            }
+            __m256i *dst = reinterpret_cast<__m256i *>(c + (i * n + j) * kLanes);
+            _mm256_store_si256(dst, c00);
+            _mm256_store_si256(dst + 1, c01);
+            _mm256_store_si256(dst + 2, c10);
+            _mm256_store_si256(dst + 3, c11);
+        }
+        for (; j < n; ++j) {
+            __m256i c0 = _mm256_setzero_si256(), c1 = _mm256_setzero_si256();
+            for (std::size_t k = 0; k < n; ++k) {
+                const int *x = a + (i * n + k) * kLanes;
+                const int *y = b + (k * n + j) * kLanes;
+                c0 = madd(c0, load8(x), load8(y));
+                c1 = madd(c1, load8(x + 8), load8(y + 8));
+            }
+            __m256i *dst = reinterpret_cast<__m256i *>(c + (i * n + j) * kLanes);
+            _mm256_store_si256(dst, c0);
+            _mm256_store_si256(dst + 1, c1);
+        }
+    }
+}
+
+// one zmm per element; four output elements per pass share the A load
+__attribute__((target("avx512f")))
+void group_multiply_avx512(std::size_t n, const int *a, const int *b, int *c) {
+    for (std::size_t i = 0; i < n; ++i) {
+        std::size_t j = 0;
+        for (; j + 4 <= n; j += 4) {
+            __m512i c0 = _mm512_setzero_si512(), c1 = _mm512_setzero_si512();
+            __m512i c2 = _mm512_setzero_si512(), c3 = _mm512_setzero_si512();
+            for (std::size_t k = 0; k < n; ++k) {
+                const __m512i x = load16(a + (i * n + k) * kLanes);
+                const int *y = b + (k * n + j) * kLanes;
+                c0 = madd(c0, x, load16(y));
+                c1 = madd(c1, x, load16(y + kLanes));
+                c2 = madd(c2, x, load16(y + 2 * kLanes));
+                c3 = madd(c3, x, load16(y + 3 * kLanes));
+            }
+            int *dst = c + (i * n + j) * kLanes;
+            _mm512_store_si512(dst, c0);
+            _mm512_store_si512(dst + kLanes, c1);
+            _mm512_store_si512(dst + 2 * kLanes, c2);
+            _mm512_store_si512(dst + 3 * kLanes, c3);
+        }
+        for (; j < n; ++j) {
+            __m512i acc = _mm512_setzero_si512();
+            for (std::size_t k = 0; k < n; ++k) {
+                acc = madd(acc, load16(a + (i * n + k) * kLanes), load16(b + (k * n + j) * kLanes));
+            }
+            _mm512_store_si512(c + (i * n + j) * kLanes, acc);
+        }
+    }
+}
+
+#endif // BATCH_HAVE_X86
+
+GroupMultiplyFn group_multiply(GemmIsa isa) {
+#ifdef BATCH_HAVE_X86
+    switch (isa) {
+    case GemmIsa::avx512:
+        return group_multiply_avx512;
+    case GemmIsa::avx2:
+        return group_multiply_avx2;
+    case GemmIsa::scalar:
+        break;
+    }
+#else
+    (void)isa;
+#endif
+    return group_multiply_scalar;
+}
+
+void check_batches(const MatrixBatch &a, const MatrixBatch &b, const char *message) {
+    if (a.size() != b.size() || a.count() != b.count()) {
+        throw std::runtime_error(message);
+    }
+}
+
+} // namespace
+
+MatrixBatch::MatrixBatch(std::size_t N, std::size_t count) : size_(N), count_(count) {
+    data_.assign(groups() * group_ints(), 0);
+}
+
+MatrixBatch::MatrixBatch(const std::vector<Matrix> &matrices)
+    : MatrixBatch(matrices.empty() ? 0 : matrices.front().get_size(), matrices.size()) {
+    for (std::size_t m = 0; m < matrices.size(); ++m) {
+        set_matrix(m, matrices[m]);
+    }
+}
+
+std::size_t MatrixBatch::index(std::size_t m, std::size_t i, std::size_t j) const {
+    if (m >= count_ || i >= size_ || j >= size_) {
+        throw std::out_of_range("Matrix index (" + std::to_string(i) + ", " + std::to_string(j) +
+                                ") of batch entry " + std::to_string(m) + " out of bounds for size " +
+                                std::to_string(size_) + " x " + std::to_string(count_));
+    }
+    return m / kLanes * group_ints() + (i * size_ + j) * kLanes + m % kLanes;
+}
+
+int MatrixBatch::get_value(std::size_t m, std::size_t i, std::size_t j) const {
+    return data_[index(m, i, j)];
+}
+
+void MatrixBatch::set_value(std::size_t m, std::size_t i, std::size_t j, int value) {
+    data_[index(m, i, j)] = value;
+}
+
+Matrix MatrixBatch::matrix(std::size_t m) const {
+    index(m, 0, 0);
+    Matrix result(size_);
+    const MatrixView out = result.view();
+    const int *src = group(m / kLanes) + m % kLanes;
+    for (std::size_t i = 0; i < size_; ++i) {
+        for (std::size_t j = 0; j < size_; ++j) {
+            out.row(i)[j] = src[(i * size_ + j) * kLanes];
+        }
+    }
+    return result;
+}
+
+void MatrixBatch::set_matrix(std::size_t m, const Matrix &value) {
+    if (static_cast<std::size_t>(value.get_size()) != size_) {
+        throw std::runtime_error("Matrix dimensions must match");
+    }
+    index(m, 0, 0);
+    int *dst = group(m / kLanes) + m % kLanes;
+    for (std::size_t i = 0; i < size_; ++i) {
+        const Matrix::RowReader row = value.row_reader(i);
+        for (std::size_t j = 0; j < size_; ++j) {
+            dst[(i * size_ + j) * kLanes] = row[j];
+        }
+    }
+}
+
+void batch_add(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &c) {
+    check_batches(a, b, "Matrix dimensions must match for addition");
+    if (c.size() != a.size() || c.count() != a.count()) {
+        c = MatrixBatch(a.size(), a.count());
+    }
+    // the layout is the same for all three, so this is one flat sum
+    const std::size_t ints = a.group_ints();
+    default_thread_pool().parallel_for(a.groups(), [&](std::size_t g) {
+        const int *x = a.group(g);
+        const int *y = b.group(g);
+        int *z = c.group(g);
+        for (std::size_t t = 0; t < ints; ++t) {
+            z[t] = wrapping_add(x[t], y[t]);
+        }
+    }, std::max<std::size_t>(1, kElementwiseTaskInts / std::max<std::size_t>(1, ints)));
+}
+
+void batch_multiply(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &c) {
+    check_batches(a, b, "Matrix dimensions incompatible for multiplication");
+    if (&c == &a || &c == &b) {
+        MatrixBatch result(a.size(), a.count());
+        batch_multiply(a, b, result);
+        c = std::move(result);
+        return;
+    }
+    if (c.size() != a.size() || c.count() != a.count()) {
+        c = MatrixBatch(a.size(), a.count());
+    }
+
+    const GroupMultiplyFn kernel = group_multiply(gemm_isa());
+    const std::size_t n = a.size();
+    // n multiply-adds per output int
+    const std::size_t work = std::max<std::size_t>(1, n * a.group_ints());
+    default_thread_pool().parallel_for(a.groups(), [&](std::size_t g) {
+        kernel(n, a.group(g), b.group(g), c.group(g));
+    }, std::max<std::size_t>(1, kElementwiseTaskInts / work));
+}
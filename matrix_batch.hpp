@@ -0,0 +1,60 @@
+#ifndef __MATRIX_BATCH_HPP__
+#define __MATRIX_BATCH_HPP__
+
+#include <cstddef>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "matrix.hpp"
+
+// many N x N matrices of the same (small) size, stored interleaved so that
+// one SIMD register holds the same element of kLanes different matrices.
+// the matrices are split into groups of kLanes; a group stores its N * N
+// elements in row-major order, each element as kLanes consecutive ints
+// (one per matrix), so element (i, j) of matrix g * kLanes + l is at
+// group(g)[(i * N + j) * kLanes + l]. lanes past count() are zero.
+class MatrixBatch {
+public:
+    // one cache line of ints: a zmm register, or two ymm
+    static constexpr std::size_t kLanes = kCacheLine / sizeof(int);
+
+    // count zero N x N matrices
+    MatrixBatch(std::size_t N, std::size_t count);
+    // copies of matrices, which must all be the same size (throws
+    // std::runtime_error "Matrix dimensions must match" otherwise)
+    explicit MatrixBatch(const std::vector<Matrix> &matrices);
+
+    std::size_t size() const { return size_; }
+    std::size_t count() const { return count_; }
+    std::size_t groups() const { return (count_ + kLanes - 1) / kLanes; }
+
+    int *group(std::size_t g) { return data_.data() + g * group_ints(); }
+    const int *group(std::size_t g) const { return data_.data() + g * group_ints(); }
+    std::size_t group_ints() const { return size_ * size_ * kLanes; }
+
+    // element (i, j) of matrix m; throws std::out_of_range like Matrix
+    int get_value(std::size_t m, std::size_t i, std::size_t j) const;
+    void set_value(std::size_t m, std::size_t i, std::size_t j, int value);
+
+    // matrix m as a Matrix, and back
+    Matrix matrix(std::size_t m) const;
+    void set_matrix(std::size_t m, const Matrix &value);
+
+private:
+    std::size_t index(std::size_t m, std::size_t i, std::size_t j) const;
+
+    std::size_t size_;
+    std::size_t count_;
+    std::vector<int, AlignedAllocator<int>> data_;
+};
+
+// c[m] = a[m] + b[m] and c[m] = a[m] * b[m] for every matrix m of the
+// batches. c is reshaped to match and may be a or b. the multiply runs a
+// kernel for the instruction set gemm() uses (see set_gemm_isa()), with
+// every vector lane working on a different matrix; groups are spread over
+// the thread pool. throws std::runtime_error if the batches differ in size
+// or count.
+void batch_add(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &c);
+void batch_multiply(const MatrixBatch &a, const MatrixBatch &b, MatrixBatch &c);
+
+#endif // __MATRIX_BATCH_HPP__
@@ -0,0 +1,275 @@
+#include "matrix_binary.hpp"
+#include "mapped_file.hpp"
+#include "matrix_io.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "aligned_allocator.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+constexpr char kMagic[8] = {'M', 'A', 'T', 'B', 'I', 'N', '\r', '\n'};
+
+std::uint8_t host_endianness() {
+    const std::uint16_t probe = 1;
+    std::uint8_t first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1 ? BinaryMatrixHeader::kLittleEndian : BinaryMatrixHeader::kBigEndian;
+}
+
+std::uint32_t byteswap(std::uint32_t v) { return __builtin_bswap32(v); }
+std::uint64_t byteswap(std::uint64_t v) { return __builtin_bswap64(v); }
+
+template <typename T>
+void put(char *header, std::size_t offset, T value) {
+    std::memcpy(header + offset, &value, sizeof(T));
+}
+
+template <typename T>
+T get(const char *header, std::size_t offset, bool swap) {
+    T value;
+    std::memcpy(&value, header + offset, sizeof(T));
+    return swap ? byteswap(value) : value;
+}
+
+// header for `count` N x N matrices in this machine's byte order, each
+// padded to Matrix's stride and following the header directly (the header
+// is exactly one cache line)
+void encode_header(std::size_t n, std::size_t count, char *header) {
+    const std::size_t stride = Matrix::stride_for(n);
+    std::memset(header, 0, BinaryMatrixHeader::kSize);
+    std::memcpy(header, kMagic, sizeof(kMagic));
+    put<std::uint32_t>(header, 8, BinaryMatrixHeader::kVersion);
+    put<std::uint8_t>(header, 12, host_endianness());
+    put<std::uint8_t>(header, 13, BinaryMatrixHeader::kInt32);
+    put<std::uint32_t>(header, 16, static_cast<std::uint32_t>(kCacheLine));
+    put<std::uint32_t>(header, 20, static_cast<std::uint32_t>(count));
+    put<std::uint64_t>(header, 24, n);
+    put<std::uint64_t>(header, 32, stride);
+    put<std::uint64_t>(header, 40, BinaryMatrixHeader::kSize);
+    put<std::uint64_t>(header, 48, n * stride * sizeof(int));
+}
+
+// bytes holds the first `got` bytes of a file of `size` bytes
+BinaryMatrixHeader parse_header(const char *bytes, std::size_t got, std::size_t size, const std::string &filename) {
+    if (got < BinaryMatrixHeader::kSize || std::memcmp(bytes, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("Not a binary matrix file: " + filename);
+    }
+
+    BinaryMatrixHeader header;
+    header.endianness = static_cast<std::uint8_t>(bytes[12]);
+    header.element_type = static_cast<std::uint8_t>(bytes[13]);
+    if (header.endianness != BinaryMatrixHeader::kLittleEndian && header.endianness != BinaryMatrixHeader::kBigEndian) {
+        throw std::runtime_error("Unknown byte order in binary matrix file " + filename);
+    }
+    const bool swap = header.endianness != host_endianness();
+    header.version = get<std::uint32_t>(bytes, 8, swap);
+    header.alignment = get<std::uint32_t>(bytes, 16, swap);
+    header.count = get<std::uint32_t>(bytes, 20, swap);
+    header.n = get<std::uint64_t>(bytes, 24, swap);
+    header.row_stride = get<std::uint64_t>(bytes, 32, swap);
+    header.payload_offset = get<std::uint64_t>(bytes, 40, swap);
+    header.matrix_bytes = get<std::uint64_t>(bytes, 48, swap);
+
+    if (header.version != BinaryMatrixHeader::kVersion) {
+        throw std::runtime_error("Unsupported binary matrix file version " + std::to_string(header.version) +
+                                 " in " + filename);
+    }
+    if (header.element_type != BinaryMatrixHeader::kInt32) {
+        throw std::runtime_error("Unsupported element type in binary matrix file " + filename);
+    }
+    // matrix_bytes == n * row_stride * sizeof(int), checked without overflow
+    const std::uint64_t row_bytes = header.row_stride * sizeof(int);
+    const bool layout_ok = header.row_stride >= header.n && header.row_stride <= size / sizeof(int) &&
+                           (header.n == 0 ? header.matrix_bytes == 0
+                                          : header.matrix_bytes % row_bytes == 0 && header.matrix_bytes / row_bytes == header.n);
+    if (!layout_ok || header.payload_offset < BinaryMatrixHeader::kSize) {
+        throw std::runtime_error("Corrupt header in binary matrix file " + filename);
+    }
+    return header;
+}
+
+// check that the payload the header describes is inside the file
+void check_payload(const BinaryMatrixHeader &header, std::size_t size, const std::string &filename) {
+    if (header.payload_offset > size ||
+        (header.matrix_bytes != 0 && header.count > (size - header.payload_offset) / header.matrix_bytes)) {
+        throw std::runtime_error("Binary matrix file " + filename + " is truncated");
+    }
+}
+
+// Matrix::wrap needs the exact stride and zeroed padding; anything else
+// (including files from the other byte order) is copied
+bool can_wrap(const BinaryMatrixHeader &header, const char *payload) {
+    if (header.endianness != host_endianness() || header.row_stride != Matrix::stride_for(header.n) ||
+        reinterpret_cast<std::uintptr_t>(payload) % kCacheLine != 0) {
+        return false;
+    }
+    const int *data = reinterpret_cast<const int *>(payload);
+    for (std::uint64_t i = 0; i < header.n; ++i) {
+        const int *row = data + i * header.row_stride;
+        for (std::uint64_t j = header.n; j < header.row_stride; ++j) {
+            if (row[j] != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+Matrix copy_matrix(const BinaryMatrixHeader &header, const char *payload) {
+    const std::size_t n = static_cast<std::size_t>(header.n);
+    const bool swap = header.endianness != host_endianness();
+    Matrix m(n);
+    const MatrixView out = m.view();
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const char *src = payload + i * header.row_stride * sizeof(int);
+        int *dst = out.row(i);
+        std::memcpy(dst, src, n * sizeof(int));
+        if (swap) {
+            for (std::size_t j = 0; j < n; ++j) {
+                dst[j] = static_cast<int>(byteswap(static_cast<std::uint32_t>(dst[j])));
+            }
+        }
+    });
+    return m;
+}
+
+} // namespace
+
+bool is_native_byte_order(const BinaryMatrixHeader &header) {
+    return header.endianness == host_endianness();
+}
+
+bool is_binary_matrix_file(const std::string &filename) {
+    std::FILE *file = std::fopen(filename.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[sizeof(kMagic)];
+    const bool match = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                       std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+    std::fclose(file);
+    return match;
+}
+
+BinaryMatrixHeader read_binary_header(const std::string &filename) {
+    std::FILE *file = std::fopen(filename.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("Could not open file " + filename);
+    }
+    char bytes[BinaryMatrixHeader::kSize];
+    const std::size_t got = std::fread(bytes, 1, sizeof(bytes), file);
+    std::fseek(file, 0, SEEK_END);
+    const long size = std::ftell(file);
+    std::fclose(file);
+
+    const std::size_t file_size = size < 0 ? 0 : static_cast<std::size_t>(size);
+    const BinaryMatrixHeader header = parse_header(bytes, got, file_size, filename);
+    check_payload(header, file_size, filename);
+    return header;
+}
+
+void create_binary_matrix_file(const std::string &filename, std::size_t n, std::size_t count) {
+    char header[BinaryMatrixHeader::kSize];
+    encode_header(n, count, header);
+
+    std::FILE *file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not open file " + filename);
+    }
+    const bool written = std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    if (std::fclose(file) != 0 || !written) {
+        throw std::runtime_error("Could not write file " + filename);
+    }
+    // extend without writing: the payload reads back as zeros and takes no
+    // disk space until it is written
+    const std::uint64_t bytes = BinaryMatrixHeader::kSize + count * n * Matrix::stride_for(n) * sizeof(int);
+    if (::truncate(filename.c_str(), static_cast<off_t>(bytes)) != 0) {
+        throw std::runtime_error("Could not write file " + filename);
+    }
+}
+
+void save_binary_matrices(const std::string &filename, const std::vector<Matrix> &matrices) {
+    const std::size_t n = matrices.empty() ? 0 : matrices.front().get_size();
+    for (const Matrix &m : matrices) {
+        if (static_cast<std::size_t>(m.get_size()) != n) {
+            throw std::invalid_argument("Matrices in one binary file must all be the same size");
+        }
+    }
+    const std::size_t stride = Matrix::stride_for(n);
+
+    char header[BinaryMatrixHeader::kSize];
+    encode_header(n, matrices.size(), header);
+
+    std::FILE *file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not open file " + filename);
+    }
+    bool ok = std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    // rows go out in logical order (pending swaps applied), zero-padded to
+    // the stride, a block of rows per fwrite
+    const std::size_t block_rows = std::max<std::size_t>(1, (std::size_t(1) << 18) / std::max<std::size_t>(stride, 1));
+    std::vector<int> block(block_rows * stride);
+    for (const Matrix &m : matrices) {
+        for (std::size_t first = 0; ok && first < n; first += block_rows) {
+            const std::size_t rows = std::min(block_rows, n - first);
+            for (std::size_t r = 0; r < rows; ++r) {
+                const Matrix::RowReader row = m.row_reader(first + r);
+                int *dst = block.data() + r * stride;
+                for (std::size_t j = 0; j < n; ++j) {
+                    dst[j] = row[j];
+                }
+                std::fill(dst + n, dst + stride, 0);
+            }
+            ok = std::fwrite(block.data(), sizeof(int), rows * stride, file) == rows * stride;
+        }
+    }
+    if (std::fclose(file) != 0 || !ok) {
+        throw std::runtime_error("Could not write file " + filename);
+    }
+}
+
+std::vector<Matrix> load_binary_matrices(const std::string &filename) {
+    auto file = std::make_shared<MappedFile>(filename);
+    const BinaryMatrixHeader header = parse_header(file->data(), file->size(), file->size(), filename);
+    check_payload(header, file->size(), filename);
+
+    std::vector<Matrix> matrices;
+    matrices.reserve(header.count);
+    for (std::uint32_t k = 0; k < header.count; ++k) {
+        char *payload = file->data() + header.payload_offset + k * header.matrix_bytes;
+        if (can_wrap(header, payload)) {
+            matrices.push_back(Matrix::wrap(file, reinterpret_cast<int *>(payload), header.n));
+        } else {
+            matrices.push_back(copy_matrix(header, payload));
+        }
+    }
+    return matrices;
+}
+
+void save_matrices_binary(const std::string &filename, const Matrix &a, const Matrix &b) {
+    save_binary_matrices(filename, {a, b});
+}
+
+void load_matrices_binary(const std::string &filename, Matrix &a, Matrix &b) {
+    std::vector<Matrix> matrices = load_binary_matrices(filename);
+    if (matrices.size() != 2 || matrices[0].get_size() == 0) {
+        throw std::runtime_error("Binary matrix file " + filename + " does not hold an A / B pair");
+    }
+    a = std::move(matrices[0]);
+    b = std::move(matrices[1]);
+}
+
+void convert_text_to_binary(const std::string &text_file, const std::string &binary_file) {
+    Matrix a(0), b(0);
+    load_matrices_parallel(text_file, a, b);
+    save_matrices_binary(binary_file, a, b);
+}
@@ -0,0 +1,83 @@
+#ifndef __MATRIX_BINARY_HPP__
+#define __MATRIX_BINARY_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "matrix.hpp"
+
+// binary matrix files. a 64-byte header is followed by `count` N x N
+// matrices, each stored row-major with rows `row_stride` elements apart and
+// every matrix starting on an `alignment`-byte boundary. files are written
+// in the writer's byte order with the same row padding Matrix uses, so on a
+// matching machine the payload is mapped and used as matrix storage as is.
+//
+// header layout (byte offsets, integers in the file's byte order):
+//    0  magic "MATBIN\r\n"
+//    8  u32 version (1)
+//   12  u8  endianness (1 little, 2 big)
+//   13  u8  element type (1 = int32)
+//   14  u16 reserved
+//   16  u32 alignment in bytes
+//   20  u32 matrix count
+//   24  u64 N
+//   32  u64 row stride in elements
+//   40  u64 offset of the first matrix
+//   48  u64 bytes per matrix (N * row stride * element size)
+//   56  u64 reserved
+struct BinaryMatrixHeader {
+    static constexpr std::size_t kSize = 64;
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::uint8_t kLittleEndian = 1;
+    static constexpr std::uint8_t kBigEndian = 2;
+    static constexpr std::uint8_t kInt32 = 1;
+
+    std::uint32_t version = kVersion;
+    std::uint8_t endianness = 0;
+    std::uint8_t element_type = kInt32;
+    std::uint32_t alignment = 0;
+    std::uint32_t count = 0;
+    std::uint64_t n = 0;
+    std::uint64_t row_stride = 0;
+    std::uint64_t payload_offset = 0;
+    std::uint64_t matrix_bytes = 0;
+};
+
+// true if the header's byte order is this machine's
+bool is_native_byte_order(const BinaryMatrixHeader &header);
+
+// true if the file exists and starts with the binary magic
+bool is_binary_matrix_file(const std::string &filename);
+
+// read and check the header of a binary matrix file. throws
+// std::runtime_error if the file cannot be opened, is not a binary matrix
+// file, or has a version, element type or layout this reader does not know.
+BinaryMatrixHeader read_binary_header(const std::string &filename);
+
+// write matrices (all the same size) to a binary matrix file. throws
+// std::runtime_error if the file cannot be written, std::invalid_argument if
+// the sizes differ.
+void save_binary_matrices(const std::string &filename, const std::vector<Matrix> &matrices);
+
+// a binary matrix file of `count` zero N x N matrices, in this machine's
+// byte order with Matrix's row stride. the payload is allocated by
+// extending the file, not by writing it.
+void create_binary_matrix_file(const std::string &filename, std::size_t n, std::size_t count = 1);
+
+// every matrix in a binary matrix file. when the file's byte order and row
+// stride match this machine the matrices wrap the mapped payload without
+// copying (see Matrix::wrap) and keep the mapping alive between them;
+// otherwise each one is converted into fresh storage.
+std::vector<Matrix> load_binary_matrices(const std::string &filename);
+
+// the A / B pair of input.txt as a binary file, and back
+void save_matrices_binary(const std::string &filename, const Matrix &a, const Matrix &b);
+void load_matrices_binary(const std::string &filename, Matrix &a, Matrix &b);
+
+// rewrite a text input file (N, A, B) as a binary one. errors are the text
+// loader's.
+void convert_text_to_binary(const std::string &text_file, const std::string &binary_file);
+
+#endif // __MATRIX_BINARY_HPP__
@@ -0,0 +1,513 @@
+#include "matrix_io.hpp"
+#include "mapped_file.hpp"
+#include "matrix_binary.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+
+#include "thread_pool.hpp"
+
+namespace {
+
+bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// fill one matrix from next(int &), reporting the first element that fails
+template <typename Next>
+void read_matrix(Next &&next, Matrix &m, std::size_t n, const char *name) {
+    for (std::size_t i = 0; i < n; ++i) {
+        int *row = m.row(i);
+        for (std::size_t j = 0; j < n; ++j) {
+            if (!next(row[j])) {
+                throw std::runtime_error("Failed to read element for Matrix " + std::string(name) + " at [" +
+                                         std::to_string(i) + "][" + std::to_string(j) + "]");
+            }
+        }
+    }
+}
+
+std::runtime_error element_error(std::size_t index, std::size_t n) {
+    const std::size_t per_matrix = n * n;
+    const char *name = index < per_matrix ? "A" : "B";
+    const std::size_t offset = index % per_matrix;
+    return std::runtime_error("Failed to read element for Matrix " + std::string(name) + " at [" +
+                              std::to_string(offset / n) + "][" + std::to_string(offset % n) + "]");
+}
+
+// smallest chunk worth a task of its own for the parallel parser
+constexpr std::size_t kMinParseChunk = 256 * 1024;
+
+} // namespace
+
+bool parse_int(const char *&p, const char *end, int &out) {
+    while (p != end && is_space(*p)) {
+        ++p;
+    }
+    if (p == end) {
+        return false;
+    }
+    // from_chars takes '-' but not '+'
+    if (*p == '+' && end - p > 1 && *(p + 1) != '-') {
+        ++p;
+    }
+    const std::from_chars_result result = std::from_chars(p, end, out);
+    if (result.ec != std::errc()) {
+        return false;
+    }
+    p = result.ptr;
+    return true;
+}
+
+IntReader::IntReader(const std::string &filename, std::size_t buffer_size)
+    : file_(std::fopen(filename.c_str(), "rb")), buffer_(buffer_size < 64 ? 64 : buffer_size) {}
+
+IntReader::~IntReader() {
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+bool IntReader::refill() {
+    if (eof_) {
+        return false;
+    }
+    std::memmove(buffer_.data(), buffer_.data() + pos_, len_ - pos_);
+    len_ -= pos_;
+    pos_ = 0;
+    const std::size_t got = std::fread(buffer_.data() + len_, 1, buffer_.size() - len_, file_);
+    len_ += got;
+    if (got == 0) {
+        eof_ = true;
+    }
+    return got != 0;
+}
+
+bool IntReader::next(int &out) {
+    if (!file_) {
+        return false;
+    }
+    for (;;) {
+        while (pos_ < len_ && is_space(buffer_[pos_])) {
+            ++pos_;
+        }
+        if (pos_ < len_ || !refill()) {
+            break;
+        }
+    }
+    if (pos_ == len_) {
+        return false;
+    }
+
+    // make sure the whole token is in the buffer before parsing it
+    std::size_t token_end = pos_;
+    for (;;) {
+        while (token_end < len_ && !is_space(buffer_[token_end])) {
+            ++token_end;
+        }
+        if (token_end < len_ || eof_) {
+            break;
+        }
+        token_end -= pos_;
+        if (pos_ == 0 && len_ == buffer_.size()) {
+            return false; // a single token larger than the whole buffer
+        }
+        refill();
+    }
+
+    const char *p = buffer_.data() + pos_;
+    if (!parse_int(p, buffer_.data() + token_end, out)) {
+        return false;
+    }
+    pos_ = static_cast<std::size_t>(p - buffer_.data());
+    return true;
+}
+
+void load_matrices(const std::string &filename, Matrix &a, Matrix &b) {
+    IntReader reader(filename);
+    if (!reader.is_open()) {
+        throw std::runtime_error("Could not open file " + filename);
+    }
+
+    int n = 0;
+    if (!reader.next(n) || n <= 0) {
+        throw std::runtime_error("Invalid or missing matrix size N in file");
+    }
+
+    a = Matrix(n);
+    b = Matrix(n);
+    auto next = [&reader](int &out) { return reader.next(out); };
+    read_matrix(next, a, n, "A");
+    read_matrix(next, b, n, "B");
+}
+
+void load_matrices_mapped(const std::string &filename, Matrix &a, Matrix &b) {
+    const MappedFile file(filename);
+    const char *p = file.begin();
+    const char *end = file.end();
+
+    int n = 0;
+    if (!parse_int(p, end, n) || n <= 0) {
+        throw std::runtime_error("Invalid or missing matrix size N in file");
+    }
+
+    a = Matrix(n);
+    b = Matrix(n);
+    auto next = [&p, end](int &out) { return parse_int(p, end, out); };
+    read_matrix(next, a, n, "A");
+    read_matrix(next, b, n, "B");
+}
+
+std::vector<MatrixPair> load_matrix_records(const std::string &filename) {
+    std::vector<MatrixPair> records;
+    if (is_binary_matrix_file(filename)) {
+        std::vector<Matrix> matrices = load_binary_matrices(filename);
+        if (matrices.empty() || matrices.size() % 2 != 0) {
+            throw std::runtime_error("Binary matrix file " + filename + " does not hold A / B pairs");
+        }
+        for (std::size_t k = 0; k < matrices.size(); k += 2) {
+            records.push_back(MatrixPair{std::move(matrices[k]), std::move(matrices[k + 1])});
+        }
+        return records;
+    }
+
+    const MappedFile file(filename);
+    const char *p = file.begin();
+    const char *end = file.end();
+    auto next = [&p, end](int &out) { return parse_int(p, end, out); };
+    do {
+        const std::string where = " in record " + std::to_string(records.size());
+        int n = 0;
+        if (!parse_int(p, end, n) || n <= 0) {
+            throw std::runtime_error("Invalid or missing matrix size N" + where);
+        }
+        MatrixPair record{Matrix(n), Matrix(n)};
+        try {
+            read_matrix(next, record.a, n, "A");
+            read_matrix(next, record.b, n, "B");
+        } catch (const std::runtime_error &e) {
+            throw std::runtime_error(e.what() + where);
+        }
+        records.push_back(std::move(record));
+
+        while (p != end && is_space(*p)) {
+            ++p;
+        }
+    } while (p != end);
+    return records;
+}
+
+namespace {
+
+// elements that `>>` reads out of one whitespace-free token: one for a
+// plain signed number, more when numbers are glued together ("12-3" is 12
+// and -3). a token that stops reading counts its failing element, since
+// nothing after it is read.
+std::size_t token_values(const char *p, const char *end) {
+    const char *q = p;
+    if (*q == '+' || *q == '-') {
+        ++q;
+    }
+    while (q != end && *q >= '0' && *q <= '9') {
+        ++q;
+    }
+    if (q == end) {
+        return 1;
+    }
+    std::size_t count = 0;
+    int ignored = 0;
+    while (p != end) {
+        ++count;
+        if (!parse_int(p, end, ignored)) {
+            break;
+        }
+    }
+    return count;
+}
+
+// number of set flags in a tile occupancy map
+std::size_t count_tiles(const std::vector<std::atomic<unsigned char>> &tiles) {
+    std::size_t count = 0;
+    for (const auto &tile : tiles) {
+        count += tile.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+// the parallel text parser behind load_matrices_parallel() and
+// AsyncMatrixLoad. a_done runs exactly once, as soon as every element of A
+// is in place or A is known to be bad, while chunks of B may still be
+// parsing; it gets null or the error a sequential read of A would report.
+// the density counts of each matrix are gathered as its elements are
+// stored, and a_stats is complete by the time a_done runs. throws the
+// first error in the file.
+void parse_text_matrices(const MappedFile &file, Matrix &a, Matrix &b,
+                         const std::function<void(std::exception_ptr)> &a_done,
+                         DensityStats &a_stats, DensityStats &b_stats) {
+    const char *body = file.begin();
+    const char *end = file.end();
+
+    int n = 0;
+    if (!parse_int(body, end, n) || n <= 0) {
+        throw std::runtime_error("Invalid or missing matrix size N in file");
+    }
+
+    const std::size_t size = static_cast<std::size_t>(n);
+    const std::size_t per_matrix = size * size;
+    const std::size_t wanted = 2 * per_matrix;
+
+    // cut [body, end) into chunks that each start on a token boundary
+    ThreadPool &pool = default_thread_pool();
+    const std::size_t length = static_cast<std::size_t>(end - body);
+    const std::size_t chunks = std::max<std::size_t>(1, std::min(pool.size() * 4, length / kMinParseChunk));
+    std::vector<const char *> starts(chunks + 1);
+    starts[0] = body;
+    starts[chunks] = end;
+    for (std::size_t c = 1; c < chunks; ++c) {
+        const char *p = std::max(starts[c - 1], body + length * c / chunks);
+        while (p != end && p != body && !is_space(*(p - 1))) {
+            ++p;
+        }
+        starts[c] = p;
+    }
+
+    // pass 1: elements per chunk, then an exclusive prefix sum
+    std::vector<std::size_t> first_token(chunks + 1, 0);
+    pool.parallel_for(chunks, [&](std::size_t c) {
+        std::size_t count = 0;
+        const char *p = starts[c];
+        const char *stop = starts[c + 1];
+        while (p != stop) {
+            while (p != stop && is_space(*p)) {
+                ++p;
+            }
+            if (p == stop) {
+                break;
+            }
+            const char *token = p;
+            while (p != stop && !is_space(*p)) {
+                ++p;
+            }
+            count += token_values(token, p);
+        }
+        first_token[c + 1] = count;
+    }, 1);
+    for (std::size_t c = 0; c < chunks; ++c) {
+        first_token[c + 1] += first_token[c];
+    }
+
+    a = Matrix(size);
+    b = Matrix(size);
+    const MatrixView a_out = a.view();
+    const MatrixView b_out = b.view();
+
+    // nonzeros and occupied tiles of A and B. once a chunk has parsed its
+    // part of a matrix it rereads those values in one sequential pass,
+    // which costs far less than bookkeeping inside the parse loop; a tile's
+    // flag is only written while it is still clear.
+    constexpr std::size_t kB = DensityStats::kBlock;
+    const std::size_t tile_side = (size + kB - 1) / kB;
+    std::atomic<std::size_t> nonzeros[2] = {{0}, {0}};
+    std::vector<std::atomic<unsigned char>> tiles[2] = {
+        std::vector<std::atomic<unsigned char>>(tile_side * tile_side),
+        std::vector<std::atomic<unsigned char>>(tile_side * tile_side),
+    };
+    // tally the values at indices [from, to), all within one matrix
+    auto survey = [&](std::size_t from, std::size_t to) {
+        if (from >= to) {
+            return;
+        }
+        const std::size_t matrix = from < per_matrix ? 0 : 1;
+        const MatrixView &out = matrix == 0 ? a_out : b_out;
+        std::size_t count = 0;
+        for (std::size_t index = from; index < to;) {
+            const std::size_t offset = index % per_matrix;
+            const std::size_t i = offset / size;
+            const int *row = out.row(i);
+            const std::size_t end_j = std::min(size, offset % size + (to - index));
+            for (std::size_t j = offset % size; j < end_j;) {
+                const std::size_t stop = std::min(end_j, (j / kB + 1) * kB);
+                std::size_t here = 0;
+                for (; j < stop; ++j) {
+                    here += row[j] != 0;
+                }
+                if (here != 0) {
+                    count += here;
+                    std::atomic<unsigned char> &tile = tiles[matrix][i / kB * tile_side + (stop - 1) / kB];
+                    if (!tile.load(std::memory_order_relaxed)) {
+                        tile.store(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+            index += end_j - offset % size;
+        }
+        nonzeros[matrix].fetch_add(count);
+    };
+    auto finish_stats = [&](std::size_t matrix, DensityStats &stats) {
+        stats.n = size;
+        stats.nonzeros = nonzeros[matrix].load();
+        stats.blocks = count_tiles(tiles[matrix]);
+    };
+
+    // pass 2: every chunk parses its tokens into their final positions. a
+    // sequential read stops at the first bad element, so only the smallest
+    // failing index matters; running out of tokens fails at the first
+    // missing one.
+    std::atomic<std::size_t> first_error{std::min(first_token[chunks], wanted)};
+    auto fail_at = [&first_error](std::size_t index) {
+        std::size_t current = first_error.load();
+        while (index < current && !first_error.compare_exchange_weak(current, index)) {
+        }
+    };
+    // chunks whose tokens start inside A; the last of them to get past A
+    // (or give up) reports A
+    std::size_t a_chunks = 0;
+    for (std::size_t c = 0; c < chunks; ++c) {
+        a_chunks += first_token[c] < per_matrix ? 1 : 0;
+    }
+    std::atomic<std::size_t> a_pending{a_chunks};
+    auto report_a = [&] {
+        finish_stats(0, a_stats);
+        if (first_error.load() < per_matrix) {
+            a_done(std::make_exception_ptr(element_error(first_error.load(), size)));
+        } else {
+            a_done(nullptr);
+        }
+    };
+    if (a_chunks == 0) {
+        report_a();
+    }
+
+    // parse chunk c; leave_a() is called once the chunk moves on to B
+    auto parse_chunk = [&](std::size_t c, auto &leave_a) {
+        std::size_t index = first_token[c];
+        const char *p = starts[c];
+        const char *stop = starts[c + 1];
+        while (index < wanted && index < first_error.load(std::memory_order_relaxed)) {
+            if (index == per_matrix) {
+                leave_a();
+            }
+            while (p != stop && is_space(*p)) {
+                ++p;
+            }
+            if (p == stop) {
+                return;
+            }
+            const char *token_end = p;
+            while (token_end != stop && !is_space(*token_end)) {
+                ++token_end;
+            }
+
+            const std::size_t offset = index % per_matrix;
+            int &slot = (index < per_matrix ? a_out : b_out).row(offset / size)[offset % size];
+            if (!parse_int(p, token_end, slot)) {
+                fail_at(index);
+                return;
+            }
+            // like `>>`, the next element is read from where this one
+            // stopped: "12-3" yields 12 and -3, "12abc" 12 and a failure
+            ++index;
+        }
+    };
+    pool.parallel_for(chunks, [&](std::size_t c) {
+        const std::size_t first = std::min(first_token[c], wanted);
+        const std::size_t last = std::min(first_token[c + 1], wanted);
+        bool in_a = first_token[c] < per_matrix;
+        auto leave_a = [&] {
+            if (in_a) {
+                in_a = false;
+                survey(first, std::min(last, per_matrix));
+                if (a_pending.fetch_sub(1) == 1) {
+                    report_a();
+                }
+            }
+        };
+        parse_chunk(c, leave_a);
+        // however the chunk stopped, it is done with A now; elements it never
+        // reached are still zero
+        leave_a();
+        survey(std::max(first, per_matrix), last);
+    }, 1);
+
+    if (first_error.load() < wanted) {
+        throw element_error(first_error.load(), size);
+    }
+    finish_stats(1, b_stats);
+}
+
+} // namespace
+
+void load_matrices_parallel(const std::string &filename, Matrix &a, Matrix &b,
+                            DensityStats *a_stats, DensityStats *b_stats) {
+    const MappedFile file(filename);
+    DensityStats a_counts, b_counts;
+    parse_text_matrices(file, a, b, [](std::exception_ptr) {}, a_counts, b_counts);
+    if (a_stats) {
+        *a_stats = a_counts;
+    }
+    if (b_stats) {
+        *b_stats = b_counts;
+    }
+}
+
+AsyncMatrixLoad::AsyncMatrixLoad(const std::string &filename) {
+    a_future_ = a_ready_.get_future().share();
+    b_future_ = b_ready_.get_future().share();
+    worker_ = std::thread([this, filename] {
+        bool a_reported = false;
+        try {
+            if (is_binary_matrix_file(filename)) {
+                load_matrices_binary(filename, a_, b_);
+                a_stats_ = sample_density(a_);
+                b_stats_ = sample_density(b_);
+                a_reported = true;
+                a_ready_.set_value();
+            } else {
+                const MappedFile file(filename);
+                parse_text_matrices(file, a_, b_, [this, &a_reported](std::exception_ptr error) {
+                    a_reported = true;
+                    if (error) {
+                        a_ready_.set_exception(error);
+                    } else {
+                        a_ready_.set_value();
+                    }
+                }, a_stats_, b_stats_);
+            }
+            b_ready_.set_value();
+        } catch (...) {
+            if (!a_reported) {
+                a_ready_.set_exception(std::current_exception());
+            }
+            b_ready_.set_exception(std::current_exception());
+        }
+    });
+}
+
+AsyncMatrixLoad::~AsyncMatrixLoad() {
+    worker_.join();
+}
+
+Matrix AsyncMatrixLoad::a() const {
+    a_future_.get();
+    return a_;
+}
+
+Matrix AsyncMatrixLoad::b() const {
+    b_future_.get();
+    return b_;
+}
+
+DensityStats AsyncMatrixLoad::a_stats() const {
+    a_future_.get();
+    return a_stats_;
+}
+
+DensityStats AsyncMatrixLoad::b_stats() const {
+    b_future_.get();
+    return b_stats_;
+}
@@ -0,0 +1,111 @@
+#ifndef __MATRIX_IO_HPP__
+#define __MATRIX_IO_HPP__
+
+#include <cstddef>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "density.hpp"
+#include "matrix.hpp"
+
+// parse one whitespace-separated int from [p, end) the way `stream >> int`
+// does: leading whitespace is skipped, an optional sign is accepted, and
+// leading zeros are fine ("01"). on success p is left just past the digits.
+// returns false (p unspecified) at end of input, on a non-numeric token or
+// on a value that does not fit in an int.
+bool parse_int(const char *&p, const char *end, int &out);
+
+// pulls ints out of a file through a large read buffer with parse_int,
+// instead of paying for locale and sentry setup on every `>>`
+class IntReader {
+public:
+    explicit IntReader(const std::string &filename, std::size_t buffer_size = 1 << 20);
+    ~IntReader();
+
+    IntReader(const IntReader &) = delete;
+    IntReader &operator=(const IntReader &) = delete;
+
+    bool is_open() const { return file_ != nullptr; }
+    // false at end of input or on a malformed token
+    bool next(int &out);
+
+private:
+    // shift unread bytes to the front and top the buffer up from the file
+    bool refill();
+
+    std::FILE *file_;
+    std::vector<char> buffer_;
+    std::size_t pos_ = 0;
+    std::size_t len_ = 0;
+    bool eof_ = false;
+};
+
+// read the text layout of input.txt: N, then the N*N values of A, then the
+// N*N values of B, all whitespace separated. throws std::runtime_error naming
+// the file, the size, or the matrix and [i][j] of the element that failed.
+void load_matrices(const std::string &filename, Matrix &a, Matrix &b);
+
+// same format and errors as load_matrices(), parsed directly out of a
+// memory mapping of the file rather than through a read buffer
+void load_matrices_mapped(const std::string &filename, Matrix &a, Matrix &b);
+
+// same format and errors as load_matrices(), parsed on the thread pool: the
+// mapped file is cut into chunks at whitespace, every chunk counts its
+// tokens, a prefix sum over the counts gives each chunk the index of its
+// first value, and the chunks then parse in parallel, writing each value
+// straight to its (matrix, i, j). the error reported is the one a
+// sequential read would hit first. the exact density counts of A and B,
+// taken as their elements are stored, go to *a_stats and *b_stats when
+// those are given.
+void load_matrices_parallel(const std::string &filename, Matrix &a, Matrix &b,
+                            DensityStats *a_stats = nullptr, DensityStats *b_stats = nullptr);
+
+// one N / A / B record
+struct MatrixPair {
+    Matrix a{0};
+    Matrix b{0};
+};
+
+// every record of a file holding one or more N / A / B records back to back
+// in the text layout, or A / B pairs in a binary matrix file. errors are
+// load_matrices()'s, with " in record <k>" added (records count from 0).
+std::vector<MatrixPair> load_matrix_records(const std::string &filename);
+
+// load_matrices_parallel() running in the background, with A handed out as
+// soon as its elements are parsed so that work needing only A can overlap
+// the rest of B. a() and b() block until their matrix is ready and throw the
+// error load_matrices_parallel() would have thrown if it stops that matrix
+// (an error inside B leaves A usable). binary matrix files are recognised by
+// their magic and mapped instead, with A and B ready together. a_stats()
+// and b_stats() wait the same way and give each matrix's density counts:
+// exact for text files, from sample_density() for binary ones. the
+// destructor waits for the load.
+class AsyncMatrixLoad {
+public:
+    explicit AsyncMatrixLoad(const std::string &filename);
+    ~AsyncMatrixLoad();
+
+    AsyncMatrixLoad(const AsyncMatrixLoad &) = delete;
+    AsyncMatrixLoad &operator=(const AsyncMatrixLoad &) = delete;
+
+    Matrix a() const;
+    Matrix b() const;
+    DensityStats a_stats() const;
+    DensityStats b_stats() const;
+
+private:
+    Matrix a_{0};
+    Matrix b_{0};
+    DensityStats a_stats_;
+    DensityStats b_stats_;
+    std::promise<void> a_ready_;
+    std::promise<void> b_ready_;
+    std::shared_future<void> a_future_;
+    std::shared_future<void> b_future_;
+    std::thread worker_;
+};
+
+#endif // __MATRIX_IO_HPP__
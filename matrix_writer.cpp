@@ -0,0 +1,187 @@
+#include "matrix_writer.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <fstream>
+#include <stdexcept>
+
+#include "thread_pool.hpp"
+
+namespace {
+
+constexpr std::size_t kFieldWidth = 6;
+
+// longest value plus a separator: "-2147483648 " for int, and room for the
+// shortest round-trip form of a double ("-2.2250738585072014e-308 "). never
+// less than the aligned field, which pads "-128" out to six characters.
+template <typename T>
+constexpr std::size_t max_value_chars() {
+    constexpr std::size_t chars = std::numeric_limits<T>::is_integer ? std::numeric_limits<T>::digits10 + 3 : 32;
+    return std::max(kFieldWidth, chars);
+}
+// below this many values a matrix is formatted on the calling thread
+constexpr std::size_t kParallelFormatValues = 256 * 1024;
+// rough size of the text one formatting task produces
+constexpr std::size_t kFormatTaskBytes = 256 * 1024;
+
+template <typename T>
+std::size_t max_row_bytes(std::size_t n) {
+    return n * max_value_chars<T>() + 1;
+}
+
+// format rows [first, last) of m at dst, which has room for
+// max_row_bytes<T>(n) per row; returns the end of the text
+template <typename T>
+char *format_rows(const BasicMatrix<T> &m, std::size_t first, std::size_t last, MatrixFormat format, char *dst) {
+    constexpr std::size_t kMaxValueChars = max_value_chars<T>();
+    const std::size_t n = m.get_size();
+    for (std::size_t i = first; i < last; ++i) {
+        const typename BasicMatrix<T>::RowReader row = m.row_reader(i);
+        if (format == MatrixFormat::aligned) {
+            for (std::size_t j = 0; j < n; ++j) {
+                char digits[kMaxValueChars];
+                const char *end = std::to_chars(digits, digits + sizeof(digits), row[j]).ptr;
+                const std::size_t len = static_cast<std::size_t>(end - digits);
+                if (len < kFieldWidth) {
+                    std::memset(dst, ' ', kFieldWidth - len);
+                    dst += kFieldWidth - len;
+                }
+                std::memcpy(dst, digits, len);
+                dst += len;
+            }
+        } else {
+            for (std::size_t j = 0; j < n; ++j) {
+                if (j != 0) {
+                    *dst++ = ' ';
+                }
+                dst = std::to_chars(dst, dst + kMaxValueChars, row[j]).ptr;
+            }
+        }
+        *dst++ = '\n';
+    }
+    return dst;
+}
+
+} // namespace
+
+MatrixWriter::MatrixWriter(std::ostream &out, std::size_t block_size)
+    : out_(out), block_(std::max<std::size_t>(block_size, 4096)) {}
+
+MatrixWriter::~MatrixWriter() {
+    flush();
+}
+
+void MatrixWriter::drain() {
+    if (used_ != 0) {
+        out_.write(block_.data(), static_cast<std::streamsize>(used_));
+        used_ = 0;
+    }
+}
+
+char *MatrixWriter::reserve(std::size_t bytes) {
+    if (block_.size() - used_ < bytes) {
+        drain();
+        if (block_.size() < bytes) {
+            block_.resize(bytes);
+        }
+    }
+    return block_.data() + used_;
+}
+
+void MatrixWriter::flush() {
+    drain();
+    out_.flush();
+}
+
+MatrixWriter &MatrixWriter::write(std::string_view text) {
+    if (text.size() > block_.size()) {
+        drain();
+        out_.write(text.data(), static_cast<std::streamsize>(text.size()));
+        return *this;
+    }
+    std::memcpy(reserve(text.size()), text.data(), text.size());
+    used_ += text.size();
+    return *this;
+}
+
+template <typename T>
+MatrixWriter &MatrixWriter::write(const BasicMatrix<T> &m, MatrixFormat format) {
+    const std::size_t n = m.get_size();
+    const std::size_t row_bytes = max_row_bytes<T>(n);
+
+    if (n * n < kParallelFormatValues) {
+        // rows straight into the block, as many per reserve() as fit
+        const std::size_t rows_per_fill = std::max<std::size_t>(1, block_.size() / row_bytes);
+        for (std::size_t first = 0; first < n; first += rows_per_fill) {
+            const std::size_t last = std::min(n, first + rows_per_fill);
+            char *start = reserve((last - first) * row_bytes);
+            used_ += static_cast<std::size_t>(format_rows(m, first, last, format, start) - start);
+        }
+        return *this;
+    }
+
+    // groups of rows format into their own buffers in parallel, a wave at a
+    // time so the text in memory stays bounded, and go out in order
+    drain();
+    ThreadPool &pool = default_thread_pool();
+    const std::size_t group_rows = std::max<std::size_t>(1, kFormatTaskBytes / row_bytes);
+    const std::size_t groups = (n + group_rows - 1) / group_rows;
+    const std::size_t wave = std::max<std::size_t>(1, pool.size() * 2);
+    std::vector<std::vector<char>> texts(std::min(wave, groups));
+    std::vector<std::size_t> lengths(texts.size());
+    for (std::size_t first_group = 0; first_group < groups; first_group += wave) {
+        const std::size_t count = std::min(wave, groups - first_group);
+        pool.parallel_for(count, [&](std::size_t g) {
+            const std::size_t first = (first_group + g) * group_rows;
+            const std::size_t last = std::min(n, first + group_rows);
+            std::vector<char> &text = texts[g];
+            text.resize((last - first) * row_bytes);
+            lengths[g] = static_cast<std::size_t>(format_rows(m, first, last, format, text.data()) - text.data());
+        }, 1);
+        for (std::size_t g = 0; g < count; ++g) {
+            out_.write(texts[g].data(), static_cast<std::streamsize>(lengths[g]));
+        }
+    }
+    return *this;
+}
+
+template <typename T>
+void write_matrix(std::ostream &out, const BasicMatrix<T> &m, MatrixFormat format) {
+    MatrixWriter(out).write(m, format);
+}
+
+template <typename T>
+void write_matrix_file(const std::string &filename, const BasicMatrix<T> &m, MatrixFormat format) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Could not open file " + filename);
+    }
+    write_matrix(out, m, format);
+    if (!out) {
+        throw std::runtime_error("Could not write file " + filename);
+    }
+}
+
+template MatrixWriter &MatrixWriter::write(const BasicMatrix<std::int8_t> &, MatrixFormat);
+template MatrixWriter &MatrixWriter::write(const BasicMatrix<std::int16_t> &, MatrixFormat);
+template MatrixWriter &MatrixWriter::write(const BasicMatrix<int> &, MatrixFormat);
+template MatrixWriter &MatrixWriter::write(const BasicMatrix<std::int64_t> &, MatrixFormat);
+template MatrixWriter &MatrixWriter::write(const BasicMatrix<float> &, MatrixFormat);
+template MatrixWriter &MatrixWriter::write(const BasicMatrix<double> &, MatrixFormat);
+
+template void write_matrix(std::ostream &, const BasicMatrix<std::int8_t> &, MatrixFormat);
+template void write_matrix(std::ostream &, const BasicMatrix<std::int16_t> &, MatrixFormat);
+template void write_matrix(std::ostream &, const BasicMatrix<int> &, MatrixFormat);
+template void write_matrix(std::ostream &, const BasicMatrix<std::int64_t> &, MatrixFormat);
+template void write_matrix(std::ostream &, const BasicMatrix<float> &, MatrixFormat);
+template void write_matrix(std::ostream &, const BasicMatrix<double> &, MatrixFormat);
+
+template void write_matrix_file(const std::string &, const BasicMatrix<std::int8_t> &, MatrixFormat);
+template void write_matrix_file(const std::string &, const BasicMatrix<std::int16_t> &, MatrixFormat);
+template void write_matrix_file(const std::string &, const BasicMatrix<int> &, MatrixFormat);
+template void write_matrix_file(const std::string &, const BasicMatrix<std::int64_t> &, MatrixFormat);
+template void write_matrix_file(const std::string &, const BasicMatrix<float> &, MatrixFormat);
+template void write_matrix_file(const std::string &, const BasicMatrix<double> &, MatrixFormat);
@@ -0,0 +1,59 @@
+#ifndef __MATRIX_WRITER_HPP__
+#define __MATRIX_WRITER_HPP__
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "matrix.hpp"
+
+enum class MatrixFormat {
+    // every value right-aligned in a field of six, like `std::setw(6)`
+    aligned,
+    // values separated by a single space; smaller and quicker to produce
+    compact,
+};
+
+// buffered text output for matrices. values are formatted with
+// std::to_chars into a large block that goes to the stream only when it
+// fills, and the stream is flushed once, by flush() or the destructor,
+// rather than once per row. big matrices are formatted on the thread pool,
+// a group of rows per task, and written in row order.
+class MatrixWriter {
+public:
+    explicit MatrixWriter(std::ostream &out, std::size_t block_size = 1 << 20);
+    ~MatrixWriter();
+
+    MatrixWriter(const MatrixWriter &) = delete;
+    MatrixWriter &operator=(const MatrixWriter &) = delete;
+
+    // every row of m, each ended by '\n'. floating-point values use the
+    // shortest form that reads back exactly.
+    template <typename T>
+    MatrixWriter &write(const BasicMatrix<T> &m, MatrixFormat format = MatrixFormat::aligned);
+    MatrixWriter &write(std::string_view text);
+
+    // hand everything buffered to the stream and flush it
+    void flush();
+
+private:
+    // make room for `bytes` more bytes, draining the block if needed
+    char *reserve(std::size_t bytes);
+    void drain();
+
+    std::ostream &out_;
+    std::vector<char> block_;
+    std::size_t used_ = 0;
+};
+
+// write m to out, or to a new file (std::runtime_error "Could not open file
+// <name>" on failure)
+template <typename T>
+void write_matrix(std::ostream &out, const BasicMatrix<T> &m, MatrixFormat format = MatrixFormat::aligned);
+template <typename T>
+void write_matrix_file(const std::string &filename, const BasicMatrix<T> &m,
+                       MatrixFormat format = MatrixFormat::aligned);
+
+#endif // __MATRIX_WRITER_HPP__
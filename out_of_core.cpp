@@ -0,0 +1,281 @@
+#include "out_of_core.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aligned_allocator.hpp"
+#include "gemm.hpp"
+#include "matrix.hpp"
+#include "matrix_binary.hpp"
+#include "thread_pool.hpp"
+#include "wrapping.hpp"
+
+namespace {
+
+using TileBuffer = std::vector<int, AlignedAllocator<int>>;
+
+// pread / pwrite until every byte is moved
+template <typename Io, typename Buffer>
+bool transfer(Io io, int fd, Buffer data, std::size_t bytes, std::size_t offset) {
+    while (bytes != 0) {
+        const ssize_t done = io(fd, data, bytes, static_cast<off_t>(offset));
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        const std::size_t moved = static_cast<std::size_t>(done);
+        data += moved;
+        bytes -= moved;
+        offset += moved;
+    }
+    return true;
+}
+
+// side of the square tiles used by the multiply: three pairs of tiles (A, B
+// and C, each double-buffered) must fit in the budget
+std::size_t multiply_tile(std::size_t n, std::size_t budget) {
+    const std::size_t per_line = kCacheLine / sizeof(int);
+    std::size_t tile = static_cast<std::size_t>(std::sqrt(static_cast<double>(budget) / (6 * sizeof(int))));
+    tile = std::max(per_line, tile / per_line * per_line);
+    return std::min(tile, Matrix::stride_for(n));
+}
+
+} // namespace
+
+DiskMatrix::DiskMatrix(const std::string &filename, std::size_t index, bool writable) : filename_(filename) {
+    const BinaryMatrixHeader header = read_binary_header(filename);
+    if (!is_native_byte_order(header)) {
+        throw std::runtime_error("Binary matrix file " + filename + " is not in this machine's byte order");
+    }
+    if (index >= header.count) {
+        throw std::runtime_error("Binary matrix file " + filename + " has no matrix " + std::to_string(index));
+    }
+    size_ = static_cast<std::size_t>(header.n);
+    stride_ = static_cast<std::size_t>(header.row_stride);
+    offset_ = static_cast<std::size_t>(header.payload_offset + index * header.matrix_bytes);
+
+    fd_ = ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd_ < 0) {
+        throw std::runtime_error("Could not open file " + filename);
+    }
+}
+
+DiskMatrix::~DiskMatrix() {
+    close();
+}
+
+DiskMatrix DiskMatrix::create(const std::string &filename, std::size_t n) {
+    create_binary_matrix_file(filename, n);
+    return DiskMatrix(filename, 0, true);
+}
+
+DiskMatrix::DiskMatrix(DiskMatrix &&other) noexcept
+    : filename_(std::move(other.filename_)), fd_(std::exchange(other.fd_, -1)), size_(std::exchange(other.size_, 0)),
+      stride_(std::exchange(other.stride_, 0)), offset_(std::exchange(other.offset_, 0)) {}
+
+DiskMatrix &DiskMatrix::operator=(DiskMatrix &&other) noexcept {
+    if (this != &other) {
+        close();
+        filename_ = std::move(other.filename_);
+        fd_ = std::exchange(other.fd_, -1);
+        size_ = std::exchange(other.size_, 0);
+        stride_ = std::exchange(other.stride_, 0);
+        offset_ = std::exchange(other.offset_, 0);
+    }
+    return *this;
+}
+
+void DiskMatrix::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool DiskMatrix::same_storage(const DiskMatrix &other) const {
+    if (offset_ != other.offset_) {
+        return false;
+    }
+    struct stat mine, theirs;
+    if (::fstat(fd_, &mine) != 0 || ::fstat(other.fd_, &theirs) != 0) {
+        return false;
+    }
+    return mine.st_dev == theirs.st_dev && mine.st_ino == theirs.st_ino;
+}
+
+void DiskMatrix::read_tile(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols,
+                           int *dst, std::size_t stride) const {
+    char *out = reinterpret_cast<char *>(dst);
+    const std::size_t start = offset_ + (row * stride_ + col) * sizeof(int);
+    // whole rows laid out like the file's come in one read, padding included
+    if (col == 0 && cols == size_ && stride == stride_) {
+        if (!transfer(::pread, fd_, out, rows * stride_ * sizeof(int), start)) {
+            throw std::runtime_error("Could not read file " + filename_);
+        }
+        return;
+    }
+    for (std::size_t i = 0; i < rows; ++i) {
+        if (!transfer(::pread, fd_, out + i * stride * sizeof(int), cols * sizeof(int),
+                      start + i * stride_ * sizeof(int))) {
+            throw std::runtime_error("Could not read file " + filename_);
+        }
+    }
+}
+
+void DiskMatrix::write_tile(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols,
+                            const int *src, std::size_t stride) {
+    const char *in = reinterpret_cast<const char *>(src);
+    const std::size_t start = offset_ + (row * stride_ + col) * sizeof(int);
+    if (col == 0 && cols == size_ && stride == stride_) {
+        if (!transfer(::pwrite, fd_, in, rows * stride_ * sizeof(int), start)) {
+            throw std::runtime_error("Could not write file " + filename_);
+        }
+        return;
+    }
+    for (std::size_t i = 0; i < rows; ++i) {
+        if (!transfer(::pwrite, fd_, in + i * stride * sizeof(int), cols * sizeof(int),
+                      start + i * stride_ * sizeof(int))) {
+            throw std::runtime_error("Could not write file " + filename_);
+        }
+    }
+}
+
+void out_of_core_add(const DiskMatrix &a, const DiskMatrix &b, DiskMatrix &c, const OutOfCoreOptions &options) {
+    const std::size_t n = a.size();
+    if (n == 0 || b.size() != n || c.size() != n) {
+        throw std::runtime_error("Matrix dimensions must match for addition");
+    }
+
+    // blocks of whole rows; A, B and C blocks are each double-buffered
+    const std::size_t stride = Matrix::stride_for(n);
+    const std::size_t block_rows =
+        std::min(n, std::max<std::size_t>(1, options.memory_budget / (6 * stride * sizeof(int))));
+    const std::size_t blocks = (n + block_rows - 1) / block_rows;
+    TileBuffer a_buf[2], b_buf[2], c_buf[2];
+    for (int s = 0; s < 2; ++s) {
+        a_buf[s].assign(block_rows * stride, 0);
+        b_buf[s].assign(block_rows * stride, 0);
+        c_buf[s].assign(block_rows * stride, 0);
+    }
+
+    // declared after the buffers so that pending I/O finishes before they go
+    std::future<void> load, store;
+    auto load_block = [&](std::size_t block) {
+        const std::size_t first = block * block_rows;
+        const std::size_t rows = std::min(block_rows, n - first);
+        const int slot = static_cast<int>(block % 2);
+        return std::async(std::launch::async, [&a, &b, &a_buf, &b_buf, first, rows, n, stride, slot] {
+            a.read_tile(first, 0, rows, n, a_buf[slot].data(), stride);
+            b.read_tile(first, 0, rows, n, b_buf[slot].data(), stride);
+        });
+    };
+
+    load = load_block(0);
+    for (std::size_t block = 0; block < blocks; ++block) {
+        load.get();
+        if (block + 1 < blocks) {
+            load = load_block(block + 1);
+        }
+
+        const int slot = static_cast<int>(block % 2);
+        const std::size_t first = block * block_rows;
+        const std::size_t rows = std::min(block_rows, n - first);
+        const int *x = a_buf[slot].data();
+        const int *y = b_buf[slot].data();
+        int *z = c_buf[slot].data();
+        default_thread_pool().parallel_for(rows, [&](std::size_t i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                z[i * stride + j] = wrapping_add(x[i * stride + j], y[i * stride + j]);
+            }
+        }, std::max<std::size_t>(1, kElementwiseTaskInts / stride));
+
+        // the other C buffer's write must be done before it is reused
+        if (store.valid()) {
+            store.get();
+        }
+        store = std::async(std::launch::async, [&c, &c_buf, first, rows, n, stride, slot] {
+            c.write_tile(first, 0, rows, n, c_buf[slot].data(), stride);
+        });
+    }
+    store.get();
+}
+
+void out_of_core_multiply(const DiskMatrix &a, const DiskMatrix &b, DiskMatrix &c, const OutOfCoreOptions &options) {
+    const std::size_t n = a.size();
+    if (n == 0 || b.size() != n) {
+        throw std::runtime_error("Matrix dimensions incompatible for multiplication");
+    }
+    if (c.size() != n) {
+        throw std::runtime_error("Result matrix size does not match the product");
+    }
+    if (c.same_storage(a) || c.same_storage(b)) {
+        throw std::invalid_argument("Result matrix must not be stored where an operand is");
+    }
+
+    const std::size_t tile = multiply_tile(n, options.memory_budget);
+    const std::size_t tiles = (n + tile - 1) / tile;
+    TileBuffer a_buf[2], b_buf[2], c_buf[2];
+    for (int s = 0; s < 2; ++s) {
+        a_buf[s].assign(tile * tile, 0);
+        b_buf[s].assign(tile * tile, 0);
+        c_buf[s].assign(tile * tile, 0);
+    }
+
+    // step s works on C(i, j) += A(i, k) * B(k, j) with k innermost, reading
+    // its A and B tiles into buffer pair s % 2
+    struct Step {
+        std::size_t i, j, k;
+    };
+    auto step_at = [tiles](std::size_t s) { return Step{s / (tiles * tiles), s / tiles % tiles, s % tiles}; };
+    auto extent = [n, tile](std::size_t t) { return std::min(tile, n - t * tile); };
+    auto load_step = [&](std::size_t s) {
+        const Step st = step_at(s);
+        const int slot = static_cast<int>(s % 2);
+        return std::async(std::launch::async, [&, st, slot] {
+            a.read_tile(st.i * tile, st.k * tile, extent(st.i), extent(st.k), a_buf[slot].data(), tile);
+            b.read_tile(st.k * tile, st.j * tile, extent(st.k), extent(st.j), b_buf[slot].data(), tile);
+        });
+    };
+
+    std::future<void> load, store;
+    const std::size_t steps = tiles * tiles * tiles;
+    load = load_step(0);
+    for (std::size_t s = 0; s < steps; ++s) {
+        load.get();
+        if (s + 1 < steps) {
+            load = load_step(s + 1);
+        }
+
+        const Step st = step_at(s);
+        const int slot = static_cast<int>(s % 2);
+        const int c_slot = static_cast<int>((st.i * tiles + st.j) % 2);
+        TileBuffer &out = c_buf[c_slot];
+        if (st.k == 0) {
+            std::fill(out.begin(), out.end(), 0);
+        }
+        gemm(ConstMatrixView{a_buf[slot].data(), tile}, ConstMatrixView{b_buf[slot].data(), tile},
+             MatrixView{out.data(), tile}, extent(st.i), extent(st.j), extent(st.k));
+
+        if (st.k + 1 == tiles) {
+            // the other C buffer's write must be done before it is reused
+            if (store.valid()) {
+                store.get();
+            }
+            store = std::async(std::launch::async, [&, st, c_slot] {
+                c.write_tile(st.i * tile, st.j * tile, extent(st.i), extent(st.j), c_buf[c_slot].data(), tile);
+            });
+        }
+    }
+    store.get();
+}
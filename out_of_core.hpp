@@ -0,0 +1,66 @@
+#ifndef __OUT_OF_CORE_HPP__
+#define __OUT_OF_CORE_HPP__
+
+#include <cstddef>
+#include <string>
+
+// one matrix of a binary matrix file (see matrix_binary.hpp) accessed in
+// place on disk, a tile at a time, for matrices too big to load. the file
+// must be in this machine's byte order.
+class DiskMatrix {
+public:
+    // matrix `index` of filename, opened for reading or for reading and
+    // writing. throws std::runtime_error if the file cannot be opened, is
+    // not a native-order binary matrix file, or has no matrix `index`.
+    explicit DiskMatrix(const std::string &filename, std::size_t index = 0, bool writable = false);
+    ~DiskMatrix();
+
+    // new file holding one zero N x N matrix, opened for writing
+    static DiskMatrix create(const std::string &filename, std::size_t n);
+
+    DiskMatrix(DiskMatrix &&other) noexcept;
+    DiskMatrix &operator=(DiskMatrix &&other) noexcept;
+    DiskMatrix(const DiskMatrix &) = delete;
+    DiskMatrix &operator=(const DiskMatrix &) = delete;
+
+    std::size_t size() const { return size_; }
+    // whether both name the same matrix of the same file, however opened
+    bool same_storage(const DiskMatrix &other) const;
+
+    // copy the rows x cols block at (row, col) to or from memory whose rows
+    // are `stride` ints apart. throws std::runtime_error on I/O failure.
+    void read_tile(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols,
+                   int *dst, std::size_t stride) const;
+    void write_tile(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols,
+                    const int *src, std::size_t stride);
+
+private:
+    void close();
+
+    std::string filename_;
+    int fd_ = -1;
+    std::size_t size_ = 0;
+    std::size_t stride_ = 0;
+    std::size_t offset_ = 0;
+};
+
+struct OutOfCoreOptions {
+    // upper bound on the tile buffers held in memory at once, in bytes
+    std::size_t memory_budget = std::size_t(256) << 20;
+};
+
+// C = A + B and C = A * B over disk-resident matrices. tiles are streamed
+// through a fixed set of buffers sized from the memory budget; the tiles
+// for the next step are read, and the previous result tile written, on an
+// I/O thread while the current step runs on the thread pool. the add
+// reads each row block before writing it, so C may be A or B; the multiply
+// writes C tiles that later steps still read A and B tiles from, so it
+// throws std::invalid_argument if C is stored where A or B is. both throw
+// std::runtime_error on mismatched sizes (with the messages operator+ and
+// operator* use, or naming the result size) or on I/O failure.
+void out_of_core_add(const DiskMatrix &a, const DiskMatrix &b, DiskMatrix &c,
+                     const OutOfCoreOptions &options = OutOfCoreOptions());
+void out_of_core_multiply(const DiskMatrix &a, const DiskMatrix &b, DiskMatrix &c,
+                          const OutOfCoreOptions &options = OutOfCoreOptions());
+
+#endif // __OUT_OF_CORE_HPP__
@@ -0,0 +1,35 @@
+#include "scratch_arena.hpp"
+
+#include <mutex>
+#include <utility>
+
+namespace {
+
+std::mutex g_free_mutex;
+
+std::vector<std::unique_ptr<ScratchArena>> &free_arenas() {
+    static std::vector<std::unique_ptr<ScratchArena>> arenas;
+    return arenas;
+}
+
+} // namespace
+
+ArenaLease::ArenaLease() {
+    {
+        std::lock_guard<std::mutex> lock(g_free_mutex);
+        auto &arenas = free_arenas();
+        if (!arenas.empty()) {
+            arena_ = std::move(arenas.back());
+            arenas.pop_back();
+        }
+    }
+    if (!arena_) {
+        arena_ = std::make_unique<ScratchArena>();
+    }
+}
+
+ArenaLease::~ArenaLease() {
+    arena_->release(0);
+    std::lock_guard<std::mutex> lock(g_free_mutex);
+    free_arenas().push_back(std::move(arena_));
+}
@@ -0,0 +1,87 @@
+#ifndef __SCRATCH_ARENA_HPP__
+#define __SCRATCH_ARENA_HPP__
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+
+// bump allocator over one cache-line aligned block of bytes. recursive
+// kernels reserve() their worst case up front, then take() and release()
+// scratch in stack order, so no level of the recursion touches the heap.
+// the block is kept between uses, so a long-lived arena stops allocating
+// once it has grown to the largest problem seen. sizes are counted in ints.
+class ScratchArena {
+public:
+    // make room for `count` ints; only valid while nothing is taken
+    void reserve(std::size_t count) {
+        if (top_ != 0) {
+            throw std::logic_error("ScratchArena::reserve called while scratch is in use");
+        }
+        if (buffer_.size() < count * sizeof(int)) {
+            buffer_.resize(count * sizeof(int));
+        }
+    }
+
+    // hand out `count` ints, rounded up to keep the next block aligned
+    int *take(std::size_t count) { return take_as<int>(count); }
+
+    // the same for element types other than int: take_as<T>(count) hands
+    // out count T's, and uses up ints_for<T>(count) ints of the reservation,
+    // alignment padding included. the T's are created in the byte storage,
+    // so the scratch is never read through a pointer of another type; for
+    // the arithmetic types used here that writes nothing.
+    template <typename T>
+    static std::size_t ints_for(std::size_t count) {
+        return bytes_for<T>(count) / sizeof(int);
+    }
+    template <typename T>
+    T *take_as(std::size_t count) {
+        const std::size_t bytes = bytes_for<T>(count);
+        if (top_ + bytes > buffer_.size()) {
+            throw std::length_error("ScratchArena exhausted");
+        }
+        std::byte *p = buffer_.data() + top_;
+        top_ += bytes;
+        std::uninitialized_default_construct_n(reinterpret_cast<T *>(p), count);
+        return std::launder(reinterpret_cast<T *>(p));
+    }
+
+    // current position, to hand back to release()
+    std::size_t mark() const { return top_; }
+    void release(std::size_t mark) { top_ = mark; }
+
+private:
+    // count T's rounded up to whole cache lines, to keep the next block aligned
+    template <typename T>
+    static std::size_t bytes_for(std::size_t count) {
+        return (count * sizeof(T) + kCacheLine - 1) / kCacheLine * kCacheLine;
+    }
+
+    std::vector<std::byte, AlignedAllocator<std::byte>> buffer_;
+    std::size_t top_ = 0;
+};
+
+// borrows an arena from a process-wide free list for the lifetime of the
+// lease and hands it back afterwards. concurrent (or nested, via a thread
+// helping the pool while it waits) users each get their own arena, and
+// released arenas keep their memory for the next caller.
+class ArenaLease {
+public:
+    ArenaLease();
+    ~ArenaLease();
+
+    ArenaLease(const ArenaLease &) = delete;
+    ArenaLease &operator=(const ArenaLease &) = delete;
+
+    ScratchArena &operator*() const { return *arena_; }
+    ScratchArena *operator->() const { return arena_.get(); }
+
+private:
+    std::unique_ptr<ScratchArena> arena_;
+};
+
+#endif // __SCRATCH_ARENA_HPP__
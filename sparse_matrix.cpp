@@ -0,0 +1,628 @@
+#include "sparse_matrix.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "gemm.hpp"
+#include "gemm_kernels.hpp"
+#include "thread_pool.hpp"
+#include "wrapping.hpp"
+
+namespace {
+
+// pool grain for a loop whose iterations each touch about `work` ints
+std::size_t grain_for(std::size_t work) {
+    return std::max<std::size_t>(1, kElementwiseTaskInts / std::max<std::size_t>(1, work));
+}
+
+// the same rotation applied to both compressed arrays
+template <typename... Arrays>
+void rotate_entries(std::size_t first, std::size_t middle, std::size_t last, Arrays &...arrays) {
+    (std::rotate(arrays.begin() + first, arrays.begin() + middle, arrays.begin() + last), ...);
+}
+
+// b's rows with their pending column swaps applied, so they can be read
+// as contiguous physical rows
+Matrix materialized(const Matrix &b) {
+    Matrix dense = b;
+    dense.materialize();
+    return dense;
+}
+
+void check_sizes(std::size_t a, std::size_t b, const char *message) {
+    if (a != b) {
+        throw std::runtime_error(message);
+    }
+}
+
+void check_bounds(std::size_t i, std::size_t j, std::size_t size) {
+    if (i >= size || j >= size) {
+        throw std::out_of_range("Matrix index (" + std::to_string(i) + ", " + std::to_string(j) +
+                                ") out of bounds for size " + std::to_string(size));
+    }
+}
+
+// the distinct tile columns (inner index / kBlock) of outer slices [first,
+// last) of a compressed matrix, ascending
+std::vector<std::uint32_t> tile_columns(const std::vector<std::size_t> &outer,
+                                        const std::vector<std::uint32_t> &inner,
+                                        std::size_t first, std::size_t last) {
+    std::vector<std::uint32_t> cols;
+    for (std::size_t p = outer[first]; p < outer[last]; ++p) {
+        cols.push_back(static_cast<std::uint32_t>(inner[p] / BlockSparseMatrix::kBlock));
+    }
+    std::sort(cols.begin(), cols.end());
+    cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+    return cols;
+}
+
+std::size_t tile_count(std::size_t n) {
+    return (n + BlockSparseMatrix::kBlock - 1) / BlockSparseMatrix::kBlock;
+}
+
+} // namespace
+
+SparseMatrix::SparseMatrix(std::size_t N, SparseLayout layout)
+    : size_(N), layout_(layout), outer_(N + 1, 0) {}
+
+SparseMatrix::SparseMatrix(const Matrix &dense, SparseLayout layout) : SparseMatrix(dense.size()) {
+    // count each row's nonzeros, then fill the rows in parallel at their
+    // prefix-sum offsets
+    const std::size_t n = size_;
+    ThreadPool &pool = default_thread_pool();
+    pool.parallel_for(n, [&](std::size_t i) {
+        const Matrix::RowReader row = dense.row_reader(i);
+        std::size_t count = 0;
+        for (std::size_t j = 0; j < n; ++j) {
+            count += row[j] != 0;
+        }
+        outer_[i + 1] = count;
+    }, grain_for(dense.stride()));
+    for (std::size_t i = 0; i < n; ++i) {
+        outer_[i + 1] += outer_[i];
+    }
+
+    inner_.resize(outer_[n]);
+    values_.resize(outer_[n]);
+    pool.parallel_for(n, [&](std::size_t i) {
+        const Matrix::RowReader row = dense.row_reader(i);
+        std::size_t p = outer_[i];
+        for (std::size_t j = 0; j < n; ++j) {
+            if (row[j] != 0) {
+                inner_[p] = static_cast<std::uint32_t>(j);
+                values_[p] = row[j];
+                ++p;
+            }
+        }
+    }, grain_for(dense.stride()));
+
+    if (layout == SparseLayout::csc) {
+        *this = to_layout(SparseLayout::csc);
+    }
+}
+
+Matrix SparseMatrix::to_dense() const {
+    Matrix result(size_);
+    const MatrixView out = result.view();
+    const bool csr = layout_ == SparseLayout::csr;
+    // a CSC slice writes one element to many rows; those are distinct ints,
+    // so slices can still be scattered in parallel
+    default_thread_pool().parallel_for(size_, [&](std::size_t o) {
+        for (std::size_t p = outer_[o]; p < outer_[o + 1]; ++p) {
+            if (csr) {
+                out.row(o)[inner_[p]] = values_[p];
+            } else {
+                out.row(inner_[p])[o] = values_[p];
+            }
+        }
+    }, grain_for(nonzeros() / std::max<std::size_t>(1, size_) + 1));
+    return result;
+}
+
+SparseMatrix SparseMatrix::to_layout(SparseLayout layout) const {
+    if (layout == layout_) {
+        return *this;
+    }
+    // counting sort by inner index; walking the outer slices in order keeps
+    // every new slice sorted
+    SparseMatrix result(size_, layout);
+    for (std::uint32_t in : inner_) {
+        ++result.outer_[in + 1];
+    }
+    for (std::size_t o = 0; o < size_; ++o) {
+        result.outer_[o + 1] += result.outer_[o];
+    }
+    result.inner_.resize(nonzeros());
+    result.values_.resize(nonzeros());
+    std::vector<std::size_t> next(result.outer_.begin(), result.outer_.end() - 1);
+    for (std::size_t o = 0; o < size_; ++o) {
+        for (std::size_t p = outer_[o]; p < outer_[o + 1]; ++p) {
+            const std::size_t q = next[inner_[p]]++;
+            result.inner_[q] = static_cast<std::uint32_t>(o);
+            result.values_[q] = values_[p];
+        }
+    }
+    return result;
+}
+
+void SparseMatrix::check_index(std::size_t i, std::size_t j) const {
+    check_bounds(i, j, size_);
+}
+
+DensityStats SparseMatrix::density() const {
+    // tile (r, c) of a CSC matrix is tile (c, r) of its transpose, so the
+    // outer index can stand in for the row in either layout
+    constexpr std::size_t kB = BlockSparseMatrix::kBlock;
+    const std::size_t tiles = tile_count(size_);
+    std::vector<std::size_t> blocks(tiles, 0);
+    default_thread_pool().parallel_for(tiles, [&](std::size_t r) {
+        blocks[r] = tile_columns(outer_, inner_, r * kB, std::min(size_, (r + 1) * kB)).size();
+    }, grain_for(nonzeros() / std::max<std::size_t>(1, tiles) + kB));
+
+    DensityStats stats;
+    stats.n = size_;
+    stats.nonzeros = nonzeros();
+    for (std::size_t count : blocks) {
+        stats.blocks += count;
+    }
+    return stats;
+}
+
+std::size_t SparseMatrix::find(std::size_t o, std::size_t in) const {
+    const auto first = inner_.begin() + static_cast<std::ptrdiff_t>(outer_[o]);
+    const auto last = inner_.begin() + static_cast<std::ptrdiff_t>(outer_[o + 1]);
+    return static_cast<std::size_t>(std::lower_bound(first, last, in) - inner_.begin());
+}
+
+int SparseMatrix::get_value(std::size_t i, std::size_t j) const {
+    check_index(i, j);
+    const std::size_t o = layout_ == SparseLayout::csr ? i : j;
+    const std::size_t in = layout_ == SparseLayout::csr ? j : i;
+    const std::size_t p = find(o, in);
+    return p < outer_[o + 1] && inner_[p] == in ? values_[p] : 0;
+}
+
+void SparseMatrix::set_value(std::size_t i, std::size_t j, int n) {
+    check_index(i, j);
+    const std::size_t o = layout_ == SparseLayout::csr ? i : j;
+    const std::size_t in = layout_ == SparseLayout::csr ? j : i;
+    const std::size_t p = find(o, in);
+    const bool present = p < outer_[o + 1] && inner_[p] == in;
+    if (present && n != 0) {
+        values_[p] = n;
+        return;
+    }
+    if (present) {
+        inner_.erase(inner_.begin() + static_cast<std::ptrdiff_t>(p));
+        values_.erase(values_.begin() + static_cast<std::ptrdiff_t>(p));
+        for (std::size_t k = o + 1; k <= size_; ++k) {
+            --outer_[k];
+        }
+    } else if (n != 0) {
+        inner_.insert(inner_.begin() + static_cast<std::ptrdiff_t>(p), static_cast<std::uint32_t>(in));
+        values_.insert(values_.begin() + static_cast<std::ptrdiff_t>(p), n);
+        for (std::size_t k = o + 1; k <= size_; ++k) {
+            ++outer_[k];
+        }
+    }
+}
+
+int SparseMatrix::sum_diagonal_major() const {
+    int sum = 0;
+    for (std::size_t i = 0; i < size_; ++i) {
+        const std::size_t p = find(i, i);
+        if (p < outer_[i + 1] && inner_[p] == i) {
+            sum = wrapping_add(sum, values_[p]);
+        }
+    }
+    return sum;
+}
+
+int SparseMatrix::sum_diagonal_minor() const {
+    // (i, N - 1 - i) is (N - 1 - i, i) transposed, so the walk is the same
+    // in either layout
+    int sum = 0;
+    for (std::size_t o = 0; o < size_; ++o) {
+        const std::size_t in = size_ - 1 - o;
+        const std::size_t p = find(o, in);
+        if (p < outer_[o + 1] && inner_[p] == in) {
+            sum = wrapping_add(sum, values_[p]);
+        }
+    }
+    return sum;
+}
+
+void SparseMatrix::swap_outer(std::size_t a, std::size_t b) {
+    if (a > b) {
+        std::swap(a, b);
+    }
+    // [A][middle][B] -> [B][middle][A], then shift the offsets in between
+    const std::size_t a0 = outer_[a], a1 = outer_[a + 1];
+    const std::size_t b0 = outer_[b], b1 = outer_[b + 1];
+    rotate_entries(a0, a1, b1, inner_, values_);
+    rotate_entries(a0, a0 + (b0 - a1), a0 + (b1 - a1), inner_, values_);
+    for (std::size_t o = a + 1; o <= b; ++o) {
+        outer_[o] = outer_[o] + (b1 - b0) - (a1 - a0);
+    }
+}
+
+void SparseMatrix::swap_inner(std::size_t a, std::size_t b) {
+    const auto ua = static_cast<std::uint32_t>(a), ub = static_cast<std::uint32_t>(b);
+    default_thread_pool().parallel_for(size_, [&](std::size_t o) {
+        const std::size_t first = outer_[o], last = outer_[o + 1];
+        bool changed = false;
+        for (std::size_t p = first; p < last; ++p) {
+            if (inner_[p] == ua || inner_[p] == ub) {
+                inner_[p] = inner_[p] == ua ? ub : ua;
+                changed = true;
+            }
+        }
+        if (!changed) {
+            return;
+        }
+        // at most two entries moved; re-sort the slice by inner index
+        std::vector<std::pair<std::uint32_t, int>> slice;
+        slice.reserve(last - first);
+        for (std::size_t p = first; p < last; ++p) {
+            slice.emplace_back(inner_[p], values_[p]);
+        }
+        std::sort(slice.begin(), slice.end());
+        for (std::size_t p = first; p < last; ++p) {
+            inner_[p] = slice[p - first].first;
+            values_[p] = slice[p - first].second;
+        }
+    }, grain_for(nonzeros() / std::max<std::size_t>(1, size_) + 1));
+}
+
+void SparseMatrix::swap_rows(std::size_t r1, std::size_t r2) {
+    check_index(r1, r2);
+    if (r1 == r2) {
+        return;
+    }
+    if (layout_ == SparseLayout::csr) {
+        swap_outer(r1, r2);
+    } else {
+        swap_inner(r1, r2);
+    }
+}
+
+void SparseMatrix::swap_cols(std::size_t c1, std::size_t c2) {
+    check_index(c1, c2);
+    if (c1 == c2) {
+        return;
+    }
+    if (layout_ == SparseLayout::csc) {
+        swap_outer(c1, c2);
+    } else {
+        swap_inner(c1, c2);
+    }
+}
+
+Matrix operator+(const SparseMatrix &a, const Matrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions must match for addition");
+    Matrix result = b;
+    const MatrixView out = result.view();
+    const bool csr = a.layout() == SparseLayout::csr;
+    const auto &outer = a.outer();
+    const auto &inner = a.inner();
+    const auto &values = a.values();
+    default_thread_pool().parallel_for(a.size(), [&](std::size_t o) {
+        for (std::size_t p = outer[o]; p < outer[o + 1]; ++p) {
+            if (csr) {
+                out.row(o)[inner[p]] = wrapping_add(out.row(o)[inner[p]], values[p]);
+            } else {
+                out.row(inner[p])[o] = wrapping_add(out.row(inner[p])[o], values[p]);
+            }
+        }
+    }, grain_for(a.nonzeros() / std::max<std::size_t>(1, a.size()) + 1));
+    return result;
+}
+
+Matrix operator+(const Matrix &a, const SparseMatrix &b) {
+    return b + a;
+}
+
+SparseMatrix operator+(const SparseMatrix &a, const SparseMatrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions must match for addition");
+    const SparseMatrix other = b.to_layout(a.layout());
+    const std::size_t n = a.size();
+
+    // merge slice o of both operands, dropping sums that cancel; with null
+    // outputs it only counts
+    auto merge = [&](std::size_t o, std::uint32_t *inner, int *values) {
+        std::size_t p = a.outer_[o], q = other.outer_[o], count = 0;
+        const std::size_t p_end = a.outer_[o + 1], q_end = other.outer_[o + 1];
+        while (p < p_end || q < q_end) {
+            std::uint32_t in;
+            int value;
+            if (q == q_end || (p < p_end && a.inner_[p] < other.inner_[q])) {
+                in = a.inner_[p];
+                value = a.values_[p++];
+            } else if (p == p_end || other.inner_[q] < a.inner_[p]) {
+                in = other.inner_[q];
+                value = other.values_[q++];
+            } else {
+                in = a.inner_[p];
+                value = wrapping_add(a.values_[p], other.values_[q]);
+                ++p;
+                ++q;
+            }
+            if (value != 0) {
+                if (inner) {
+                    inner[count] = in;
+                    values[count] = value;
+                }
+                ++count;
+            }
+        }
+        return count;
+    };
+
+    SparseMatrix result(n, a.layout());
+    ThreadPool &pool = default_thread_pool();
+    const std::size_t grain = grain_for((a.nonzeros() + other.nonzeros()) / std::max<std::size_t>(1, n) + 1);
+    pool.parallel_for(n, [&](std::size_t o) { result.outer_[o + 1] = merge(o, nullptr, nullptr); }, grain);
+    for (std::size_t o = 0; o < n; ++o) {
+        result.outer_[o + 1] += result.outer_[o];
+    }
+    result.inner_.resize(result.outer_[n]);
+    result.values_.resize(result.outer_[n]);
+    pool.parallel_for(n, [&](std::size_t o) {
+        merge(o, result.inner_.data() + result.outer_[o], result.values_.data() + result.outer_[o]);
+    }, grain);
+    return result;
+}
+
+Matrix operator*(const SparseMatrix &a, const Matrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const SparseMatrix rows = a.to_layout(SparseLayout::csr);
+    const Matrix dense = materialized(b);
+    const std::size_t n = a.size();
+    Matrix result(n);
+    const MatrixView out = result.view();
+    // row i of C is the sum of A(i, k) * row k of B over the nonzeros of
+    // row i of A
+    const auto &outer = rows.outer();
+    const auto &inner = rows.inner();
+    const auto &values = rows.values();
+    const AxpyFn axpy = axpy_kernel(gemm_isa());
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        int *c = out.row(i);
+        for (std::size_t p = outer[i]; p < outer[i + 1]; ++p) {
+            axpy(n, values[p], dense.row(inner[p]), c);
+        }
+    }, grain_for(dense.stride() * (rows.nonzeros() / std::max<std::size_t>(1, n) + 1)));
+    return result;
+}
+
+Matrix operator*(const Matrix &a, const SparseMatrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const SparseMatrix rows = b.to_layout(SparseLayout::csr);
+    const std::size_t n = a.size();
+    Matrix result(n);
+    const MatrixView out = result.view();
+    // row i of C is the sum of A(i, k) * row k of B over the nonzeros of
+    // row i of A, each a scatter of row k's nonzeros
+    const auto &outer = rows.outer();
+    const auto &inner = rows.inner();
+    const auto &values = rows.values();
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const Matrix::RowReader row = a.row_reader(i);
+        int *c = out.row(i);
+        for (std::size_t k = 0; k < n; ++k) {
+            const int v = row[k];
+            if (v == 0) {
+                continue;
+            }
+            for (std::size_t p = outer[k]; p < outer[k + 1]; ++p) {
+                c[inner[p]] = wrapping_madd(c[inner[p]], v, values[p]);
+            }
+        }
+    }, grain_for(a.stride() + rows.nonzeros()));
+    return result;
+}
+
+SparseMatrix operator*(const SparseMatrix &a, const SparseMatrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const SparseMatrix lhs = a.to_layout(SparseLayout::csr);
+    const SparseMatrix rhs = b.to_layout(SparseLayout::csr);
+    const std::size_t n = a.size();
+
+    // Gustavson: row i of C accumulates A(i, k) * row k of B in a dense
+    // scratch row, touching only the columns that occur. the scratch is
+    // per thread: a row task never waits on the pool.
+    std::vector<std::vector<std::pair<std::uint32_t, int>>> rows(n);
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        thread_local std::vector<int> acc;
+        thread_local std::vector<char> seen;
+        thread_local std::vector<std::uint32_t> touched;
+        if (acc.size() < n) {
+            acc.assign(n, 0);
+            seen.assign(n, 0);
+        }
+        touched.clear();
+        for (std::size_t p = lhs.outer_[i]; p < lhs.outer_[i + 1]; ++p) {
+            const int v = lhs.values_[p];
+            const std::size_t k = lhs.inner_[p];
+            for (std::size_t q = rhs.outer_[k]; q < rhs.outer_[k + 1]; ++q) {
+                const std::uint32_t j = rhs.inner_[q];
+                if (!seen[j]) {
+                    seen[j] = 1;
+                    touched.push_back(j);
+                }
+                acc[j] = wrapping_madd(acc[j], v, rhs.values_[q]);
+            }
+        }
+        std::sort(touched.begin(), touched.end());
+        for (std::uint32_t j : touched) {
+            if (acc[j] != 0) {
+                rows[i].emplace_back(j, acc[j]);
+            }
+            acc[j] = 0;
+            seen[j] = 0;
+        }
+    }, grain_for(lhs.nonzeros() / std::max<std::size_t>(1, n) + 1));
+
+    SparseMatrix result(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        result.outer_[i + 1] = result.outer_[i] + rows[i].size();
+    }
+    result.inner_.resize(result.outer_[n]);
+    result.values_.resize(result.outer_[n]);
+    for (std::size_t i = 0; i < n; ++i) {
+        std::size_t p = result.outer_[i];
+        for (const auto &entry : rows[i]) {
+            result.inner_[p] = entry.first;
+            result.values_[p++] = entry.second;
+        }
+    }
+    return result.to_layout(a.layout());
+}
+
+BlockSparseMatrix::BlockSparseMatrix(std::size_t N) : size_(N), block_outer_(tile_count(N) + 1, 0) {}
+
+BlockSparseMatrix::BlockSparseMatrix(const SparseMatrix &sparse) : BlockSparseMatrix(sparse.size()) {
+    const SparseMatrix rows = sparse.to_layout(SparseLayout::csr);
+    const std::size_t n = size_;
+    const std::size_t tile_rows = tile_count(n);
+    const std::size_t grain = grain_for(rows.nonzeros() / std::max<std::size_t>(1, tile_rows) + kBlock);
+    ThreadPool &pool = default_thread_pool();
+
+    // the occupied tiles of every tile row, then their prefix-sum offsets
+    std::vector<std::vector<std::uint32_t>> cols(tile_rows);
+    pool.parallel_for(tile_rows, [&](std::size_t r) {
+        cols[r] = tile_columns(rows.outer_, rows.inner_, r * kBlock, std::min(n, (r + 1) * kBlock));
+    }, grain);
+    for (std::size_t r = 0; r < tile_rows; ++r) {
+        block_outer_[r + 1] = block_outer_[r] + cols[r].size();
+    }
+    block_cols_.resize(block_outer_[tile_rows]);
+    values_.assign(block_cols_.size() * kBlock * kBlock, 0);
+
+    // each row's nonzeros go to the tile of their column; both ascend, so
+    // the tile is found by walking forward
+    pool.parallel_for(tile_rows, [&](std::size_t r) {
+        std::copy(cols[r].begin(), cols[r].end(), block_cols_.begin() + static_cast<std::ptrdiff_t>(block_outer_[r]));
+        int *base = values_.data() + block_outer_[r] * kBlock * kBlock;
+        const std::size_t stride = panel_stride(r);
+        for (std::size_t i = r * kBlock; i < std::min(n, (r + 1) * kBlock); ++i) {
+            int *row = base + (i - r * kBlock) * stride;
+            std::size_t q = 0;
+            for (std::size_t p = rows.outer_[i]; p < rows.outer_[i + 1]; ++p) {
+                const std::size_t j = rows.inner_[p];
+                while (cols[r][q] != j / kBlock) {
+                    ++q;
+                }
+                row[q * kBlock + j % kBlock] = rows.values_[p];
+            }
+        }
+    }, grain);
+}
+
+BlockSparseMatrix::BlockSparseMatrix(const Matrix &dense) : BlockSparseMatrix(SparseMatrix(dense)) {}
+
+Matrix BlockSparseMatrix::to_dense() const {
+    const std::size_t n = size_;
+    Matrix result(n);
+    const MatrixView out = result.view();
+    default_thread_pool().parallel_for(tile_count(n), [&](std::size_t r) {
+        const int *base = panel(r);
+        const std::size_t stride = panel_stride(r);
+        for (std::size_t i = r * kBlock; i < std::min(n, (r + 1) * kBlock); ++i) {
+            const int *src = base + (i - r * kBlock) * stride;
+            int *dst = out.row(i);
+            for (std::size_t q = block_outer_[r]; q < block_outer_[r + 1]; ++q) {
+                const std::size_t j = block_cols_[q] * kBlock;
+                std::copy(src, src + std::min(kBlock, n - j), dst + j);
+                src += kBlock;
+            }
+        }
+    }, grain_for(kBlock * result.stride()));
+    return result;
+}
+
+SparseMatrix BlockSparseMatrix::to_sparse(SparseLayout layout) const {
+    // padding is zero, so every nonzero of a panel row is a real element
+    const std::size_t n = size_;
+    SparseMatrix result(n);
+    ThreadPool &pool = default_thread_pool();
+    auto panel_row = [this](std::size_t i) { return panel(i / kBlock) + i % kBlock * panel_stride(i / kBlock); };
+    const std::size_t grain = grain_for(blocks() * kBlock / std::max<std::size_t>(1, tile_count(n)) + 1);
+    pool.parallel_for(n, [&](std::size_t i) {
+        const int *row = panel_row(i);
+        const std::size_t width = panel_stride(i / kBlock);
+        result.outer_[i + 1] = static_cast<std::size_t>(width - std::count(row, row + width, 0));
+    }, grain);
+    for (std::size_t i = 0; i < n; ++i) {
+        result.outer_[i + 1] += result.outer_[i];
+    }
+    result.inner_.resize(result.outer_[n]);
+    result.values_.resize(result.outer_[n]);
+    pool.parallel_for(n, [&](std::size_t i) {
+        const int *row = panel_row(i);
+        const std::size_t r = i / kBlock;
+        std::size_t p = result.outer_[i];
+        for (std::size_t q = block_outer_[r]; q < block_outer_[r + 1]; ++q) {
+            for (std::size_t jj = 0; jj < kBlock; ++jj, ++row) {
+                if (*row != 0) {
+                    result.inner_[p] = static_cast<std::uint32_t>(block_cols_[q] * kBlock + jj);
+                    result.values_[p++] = *row;
+                }
+            }
+        }
+    }, grain);
+    return layout == SparseLayout::csr ? result : result.to_layout(layout);
+}
+
+DensityStats BlockSparseMatrix::density() const {
+    DensityStats stats;
+    stats.n = size_;
+    stats.nonzeros = static_cast<std::size_t>(values_.size() - std::count(values_.begin(), values_.end(), 0));
+    stats.blocks = blocks();
+    return stats;
+}
+
+int BlockSparseMatrix::get_value(std::size_t i, std::size_t j) const {
+    check_bounds(i, j, size_);
+    const std::size_t r = i / kBlock;
+    const auto first = block_cols_.begin() + static_cast<std::ptrdiff_t>(block_outer_[r]);
+    const auto last = block_cols_.begin() + static_cast<std::ptrdiff_t>(block_outer_[r + 1]);
+    const auto tile = std::lower_bound(first, last, static_cast<std::uint32_t>(j / kBlock));
+    if (tile == last || *tile != j / kBlock) {
+        return 0;
+    }
+    return panel(r)[i % kBlock * panel_stride(r) + static_cast<std::size_t>(tile - first) * kBlock + j % kBlock];
+}
+
+Matrix operator*(const BlockSparseMatrix &a, const Matrix &b) {
+    constexpr std::size_t kB = BlockSparseMatrix::kBlock;
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const Matrix dense = materialized(b);
+    const std::size_t n = a.size();
+    Matrix result(n);
+    const MatrixView out = result.view();
+    // rows of B under the padding past the matrix's edge
+    const std::vector<int> zeros(n, 0);
+    const auto &outer = a.block_outer();
+    const auto &cols = a.block_cols();
+    // tile row r of C is the panel of tile row r times the rows of B its
+    // tiles face, gathered through a row table so nothing is copied
+    default_thread_pool().parallel_for(tile_count(n), [&](std::size_t r) {
+        const std::size_t tiles = outer[r + 1] - outer[r];
+        if (tiles == 0) {
+            return;
+        }
+        std::vector<const int *> rows(tiles * kB);
+        for (std::size_t q = 0; q < tiles; ++q) {
+            for (std::size_t kk = 0; kk < kB; ++kk) {
+                const std::size_t k = cols[outer[r] + q] * kB + kk;
+                rows[q * kB + kk] = k < n ? dense.row(k) : zeros.data();
+            }
+        }
+        gemm(ConstMatrixView{a.panel(r), a.panel_stride(r)}, ConstMatrixView{nullptr, 0, rows.data(), 0},
+             out.offset(r * kB, 0), std::min(kB, n - r * kB), n, tiles * kB);
+    }, 1);
+    return result;
+}
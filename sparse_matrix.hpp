@@ -0,0 +1,155 @@
+#ifndef __SPARSE_MATRIX_HPP__
+#define __SPARSE_MATRIX_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "density.hpp"
+#include "matrix.hpp"
+
+// which dimension a SparseMatrix is compressed along
+enum class SparseLayout {
+    // compressed sparse rows: the nonzeros of each row, by column
+    csr,
+    // compressed sparse columns: the nonzeros of each column, by row
+    csc,
+};
+
+// square N x N int matrix holding only its nonzeros, for matrices that are
+// mostly zeros. the nonzeros are grouped by outer index (the row for CSR,
+// the column for CSC): those of outer index o are entries
+// [outer_[o], outer_[o + 1]) of inner_ (the other coordinate, ascending)
+// and values_. memory is O(N + nonzeros), and every operation below runs
+// in time proportional to the nonzeros it touches rather than to N * N.
+//
+// arithmetic wraps like Matrix. exact zeros are never stored: setting an
+// element to zero removes it, and sums or products that cancel are dropped.
+class SparseMatrix {
+public:
+    // N x N matrix of zeros
+    explicit SparseMatrix(std::size_t N = 0, SparseLayout layout = SparseLayout::csr);
+    // the nonzeros of a dense matrix (through any pending column swaps)
+    explicit SparseMatrix(const Matrix &dense, SparseLayout layout = SparseLayout::csr);
+
+    Matrix to_dense() const;
+    // the same matrix compressed the other way (a counting-sort transpose
+    // of the index arrays, O(N + nonzeros))
+    SparseMatrix to_layout(SparseLayout layout) const;
+
+    SparseLayout layout() const { return layout_; }
+    std::size_t size() const { return size_; }
+    int get_size() const { return static_cast<int>(size_); }
+    std::size_t nonzeros() const { return values_.size(); }
+    // exact counts of the stored nonzeros
+    DensityStats density() const;
+
+    // bounds-checked like Matrix (std::out_of_range). reading, or updating
+    // an element that is already nonzero, is a binary search within one
+    // row (column); inserting or removing a nonzero moves the entries after
+    // it, O(nonzeros).
+    int get_value(std::size_t i, std::size_t j) const;
+    void set_value(std::size_t i, std::size_t j, int n);
+
+    int sum_diagonal_major() const;
+    int sum_diagonal_minor() const;
+
+    // swapping two outer slices (rows of a CSR matrix, columns of a CSC
+    // one) moves only the entries between them; swapping two inner
+    // coordinates relabels the entries that have them and re-sorts their
+    // slices. both are O(N + nonzeros) at worst.
+    void swap_rows(std::size_t r1, std::size_t r2);
+    void swap_cols(std::size_t c1, std::size_t c2);
+
+    // raw compressed arrays, for kernels
+    const std::vector<std::size_t> &outer() const { return outer_; }
+    const std::vector<std::uint32_t> &inner() const { return inner_; }
+    const std::vector<int> &values() const { return values_; }
+
+private:
+    void check_index(std::size_t i, std::size_t j) const;
+    // position of (outer, inner) in inner_ / values_, or the insertion point
+    std::size_t find(std::size_t o, std::size_t in) const;
+    void swap_outer(std::size_t a, std::size_t b);
+    void swap_inner(std::size_t a, std::size_t b);
+
+    friend SparseMatrix operator+(const SparseMatrix &a, const SparseMatrix &b);
+    friend SparseMatrix operator*(const SparseMatrix &a, const SparseMatrix &b);
+    friend class BlockSparseMatrix;
+
+    std::size_t size_;
+    SparseLayout layout_;
+    std::vector<std::size_t> outer_;
+    std::vector<std::uint32_t> inner_;
+    std::vector<int> values_;
+};
+
+// the existing operations with a sparse operand. a dense result is
+// returned whenever a dense matrix is involved. sparse * dense streams,
+// for each nonzero A(i, k), row k of B into row i of C, and dense * sparse
+// scales row k of the sparse factor by every A(i, k), so both take
+// O(N * nonzeros) rather than O(N^3). sparse * sparse is Gustavson's
+// row-by-row product and stays sparse, as does sparse + sparse. CSC
+// operands are converted to CSR where a kernel needs rows; the result of a
+// sparse-only operation has the layout of the left operand. rows are
+// spread over the thread pool. throws std::runtime_error with operator+ /
+// operator*'s messages if the sizes differ.
+Matrix operator+(const SparseMatrix &a, const Matrix &b);
+Matrix operator+(const Matrix &a, const SparseMatrix &b);
+SparseMatrix operator+(const SparseMatrix &a, const SparseMatrix &b);
+Matrix operator*(const SparseMatrix &a, const Matrix &b);
+Matrix operator*(const Matrix &a, const SparseMatrix &b);
+SparseMatrix operator*(const SparseMatrix &a, const SparseMatrix &b);
+
+// square N x N int matrix stored as the kBlock x kBlock tiles that hold a
+// nonzero (block sparse rows), for matrices whose nonzeros cluster. the
+// tiles of tile row r are block_cols()[block_outer()[r] .. block_outer()[r +
+// 1]), ascending, and are kept side by side as one dense panel of kBlock
+// rows (panel()), tiles past the matrix's edge padded with zeros. that way a
+// tile row times a dense matrix is a single gemm() call, which keeps the
+// SIMD kernels busy where CSR would walk one nonzero at a time. memory is
+// O(N + blocks * kBlock^2). arithmetic wraps like Matrix.
+class BlockSparseMatrix {
+public:
+    static constexpr std::size_t kBlock = DensityStats::kBlock;
+
+    // N x N matrix of zeros
+    explicit BlockSparseMatrix(std::size_t N = 0);
+    // the tiles of a sparse or dense matrix that hold its nonzeros
+    explicit BlockSparseMatrix(const SparseMatrix &sparse);
+    explicit BlockSparseMatrix(const Matrix &dense);
+
+    Matrix to_dense() const;
+    SparseMatrix to_sparse(SparseLayout layout = SparseLayout::csr) const;
+
+    std::size_t size() const { return size_; }
+    int get_size() const { return static_cast<int>(size_); }
+    // stored tiles
+    std::size_t blocks() const { return block_cols_.size(); }
+    // exact counts of the stored tiles
+    DensityStats density() const;
+
+    // bounds-checked like Matrix (std::out_of_range); a binary search over
+    // the tiles of one tile row
+    int get_value(std::size_t i, std::size_t j) const;
+
+    // raw tile arrays, for kernels
+    const std::vector<std::size_t> &block_outer() const { return block_outer_; }
+    const std::vector<std::uint32_t> &block_cols() const { return block_cols_; }
+    // the kBlock x (tiles * kBlock) panel of tile row r and its row stride
+    const int *panel(std::size_t r) const { return values_.data() + block_outer_[r] * kBlock * kBlock; }
+    std::size_t panel_stride(std::size_t r) const { return (block_outer_[r + 1] - block_outer_[r]) * kBlock; }
+
+private:
+    std::size_t size_;
+    std::vector<std::size_t> block_outer_;
+    std::vector<std::uint32_t> block_cols_;
+    std::vector<int, AlignedAllocator<int>> values_;
+};
+
+// block sparse * dense, one gemm() per tile row against the rows of B the
+// tiles cover. throws std::runtime_error like operator* if the sizes differ.
+Matrix operator*(const BlockSparseMatrix &a, const Matrix &b);
+
+#endif // __SPARSE_MATRIX_HPP__
@@ -0,0 +1,182 @@
+#include "strassen.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#include "scratch_arena.hpp"
+#include "wrapping.hpp"
+
+namespace {
+
+std::atomic<std::size_t> g_crossover{1024};
+
+// row length of a scratch block of width n, whole cache lines
+std::size_t scratch_stride(std::size_t n) {
+    const std::size_t per_line = kCacheLine / sizeof(int);
+    return (n + per_line - 1) / per_line * per_line;
+}
+
+MatrixView take_block(ScratchArena &arena, std::size_t n) {
+    const std::size_t stride = scratch_stride(n);
+    return MatrixView{arena.take(n * stride), stride};
+}
+
+ConstMatrixView as_const(MatrixView v) {
+    return v;
+}
+
+ConstMatrixView quadrant(ConstMatrixView v, std::size_t h, int r, int c) {
+    return v.offset(r * h, c * h);
+}
+
+MatrixView quadrant(MatrixView v, std::size_t h, int r, int c) {
+    return v.offset(r * h, c * h);
+}
+
+// out = x + y and out = x - y over an n x n block
+void add(ConstMatrixView x, ConstMatrixView y, MatrixView out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        const int *xr = x.row(i);
+        const int *yr = y.row(i);
+        int *o = out.row(i);
+        for (std::size_t j = 0; j < n; ++j) {
+            o[j] = wrapping_add(xr[j], yr[j]);
+        }
+    }
+}
+
+void sub(ConstMatrixView x, ConstMatrixView y, MatrixView out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        const int *xr = x.row(i);
+        const int *yr = y.row(i);
+        int *o = out.row(i);
+        for (std::size_t j = 0; j < n; ++j) {
+            o[j] = wrapping_sub(xr[j], yr[j]);
+        }
+    }
+}
+
+// ints of scratch used by recurse() at size n (three half-size temporaries
+// per level)
+std::size_t scratch_needed(std::size_t n, std::size_t crossover) {
+    std::size_t total = 0;
+    while (n > crossover) {
+        n /= 2;
+        total += 3 * n * scratch_stride(n);
+    }
+    return total;
+}
+
+void recurse(ConstMatrixView a, ConstMatrixView b, MatrixView c, std::size_t n,
+             std::size_t crossover, ScratchArena &arena) {
+    if (n <= crossover) {
+        for (std::size_t i = 0; i < n; ++i) {
+            std::fill(c.row(i), c.row(i) + n, 0);
+        }
+        gemm(a, b, c, n, n, n);
+        return;
+    }
+
+    const std::size_t h = n / 2;
+    const ConstMatrixView a11 = quadrant(a, h, 0, 0), a12 = quadrant(a, h, 0, 1);
+    const ConstMatrixView a21 = quadrant(a, h, 1, 0), a22 = quadrant(a, h, 1, 1);
+    const ConstMatrixView b11 = quadrant(b, h, 0, 0), b12 = quadrant(b, h, 0, 1);
+    const ConstMatrixView b21 = quadrant(b, h, 1, 0), b22 = quadrant(b, h, 1, 1);
+    const MatrixView c11 = quadrant(c, h, 0, 0), c12 = quadrant(c, h, 0, 1);
+    const MatrixView c21 = quadrant(c, h, 1, 0), c22 = quadrant(c, h, 1, 1);
+
+    const std::size_t mark = arena.mark();
+    const MatrixView s = take_block(arena, h);
+    const MatrixView t = take_block(arena, h);
+    const MatrixView p = take_block(arena, h);
+
+    // Winograd's schedule with the seven products landing in the quadrants of
+    // C where possible, so each level needs only three temporaries
+    sub(a11, a21, s, h);                                  // S3 = A11 - A21
+    sub(b22, b12, t, h);                                  // T3 = B22 - B12
+    recurse(as_const(s), as_const(t), c21, h, crossover, arena); // C21 = P7 = S3 T3
+    add(a21, a22, s, h);                                  // S1 = A21 + A22
+    sub(b12, b11, t, h);                                  // T1 = B12 - B11
+    recurse(as_const(s), as_const(t), c22, h, crossover, arena); // C22 = P5 = S1 T1
+    sub(as_const(s), a11, s, h);                          // S2 = S1 - A11
+    sub(b22, as_const(t), t, h);                          // T2 = B22 - T1
+    recurse(as_const(s), as_const(t), c12, h, crossover, arena); // C12 = P6 = S2 T2
+    sub(a12, as_const(s), s, h);                          // S4 = A12 - S2
+    recurse(as_const(s), b22, p, h, crossover, arena);    // P = P3 = S4 B22
+    recurse(a11, b11, c11, h, crossover, arena);          // C11 = P1 = A11 B11
+
+    add(as_const(c12), as_const(c11), c12, h);            // C12 = U2 = P1 + P6
+    add(as_const(c21), as_const(c12), c21, h);            // C21 = U3 = U2 + P7
+    add(as_const(c12), as_const(c22), c12, h);            // C12 = U4 = U2 + P5
+    add(as_const(c12), as_const(p), c12, h);              // C12 = U5 = U4 + P3
+    add(as_const(c22), as_const(c21), c22, h);            // C22 = U7 = U3 + P5
+
+    sub(as_const(t), b21, t, h);                          // T4 = T2 - B21
+    recurse(a22, as_const(t), p, h, crossover, arena);    // P = P4 = A22 T4
+    sub(as_const(c21), as_const(p), c21, h);              // C21 = U6 = U3 - P4
+    recurse(a12, b21, p, h, crossover, arena);            // P = P2 = A12 B21
+    add(as_const(c11), as_const(p), c11, h);              // C11 = U1 = P1 + P2
+
+    arena.release(mark);
+}
+
+// copy the n x n block of src into the top left of a zero-filled padded block
+void copy_padded(ConstMatrixView src, std::size_t n, MatrixView dst, std::size_t padded) {
+    for (std::size_t i = 0; i < padded; ++i) {
+        int *d = dst.row(i);
+        if (i < n) {
+            std::copy(src.row(i), src.row(i) + n, d);
+            std::fill(d + n, d + padded, 0);
+        } else {
+            std::fill(d, d + padded, 0);
+        }
+    }
+}
+
+} // namespace
+
+void set_strassen_crossover(std::size_t n) {
+    // below a handful of rows the extra additions can never pay off
+    g_crossover = std::max<std::size_t>(n, 2);
+}
+
+std::size_t strassen_crossover() {
+    return g_crossover;
+}
+
+void strassen_multiply(ConstMatrixView a, ConstMatrixView b, MatrixView c, std::size_t n) {
+    const std::size_t crossover = strassen_crossover();
+
+    // smallest leaf size at or below the crossover that n splits into evenly
+    // after padding: n <= leaf << levels
+    std::size_t levels = 0;
+    std::size_t leaf = n;
+    while (leaf > crossover) {
+        ++levels;
+        leaf = (n + (std::size_t{1} << levels) - 1) >> levels;
+    }
+    const std::size_t padded = leaf << levels;
+
+    ArenaLease lease;
+    ScratchArena &arena = *lease;
+    std::size_t total = scratch_needed(padded, crossover);
+    if (padded != n) {
+        total += 3 * padded * scratch_stride(padded);
+    }
+    arena.reserve(total);
+
+    if (padded == n) {
+        recurse(a, b, c, n, crossover, arena);
+        return;
+    }
+
+    const MatrixView ap = take_block(arena, padded);
+    const MatrixView bp = take_block(arena, padded);
+    const MatrixView cp = take_block(arena, padded);
+    copy_padded(a, n, ap, padded);
+    copy_padded(b, n, bp, padded);
+    recurse(as_const(ap), as_const(bp), cp, padded, crossover, arena);
+    for (std::size_t i = 0; i < n; ++i) {
+        std::copy(cp.row(i), cp.row(i) + n, c.row(i));
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef __STRASSEN_HPP__
+#define __STRASSEN_HPP__
+
+#include <cstddef>
+
+#include "gemm.hpp"
+
+// Matrix::operator* switches to Strassen-Winograd for sizes above the
+// crossover. the recursion halves the problem until it is at or below the
+// crossover and runs gemm() there.
+void set_strassen_crossover(std::size_t n);
+std::size_t strassen_crossover();
+
+// C[n x n] = A[n x n] * B[n x n] (C is overwritten) with Strassen-Winograd:
+// 7 half-size products and 15 additions per level. sizes that do not halve
+// evenly down to the leaves are zero-padded once up front. scratch comes
+// from a leased ScratchArena sized before the recursion starts.
+void strassen_multiply(ConstMatrixView a, ConstMatrixView b, MatrixView c, std::size_t n);
+
+#endif // __STRASSEN_HPP__
@@ -0,0 +1,539 @@
+#include "structured_matrix.hpp"
+
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "gemm.hpp"
+#include "gemm_kernels.hpp"
+#include "thread_pool.hpp"
+#include "wrapping.hpp"
+
+namespace {
+
+// pool grain for a loop whose iterations each touch about `work` ints
+std::size_t grain_for(std::size_t work) {
+    return std::max<std::size_t>(1, kElementwiseTaskInts / std::max<std::size_t>(1, work));
+}
+
+void check_sizes(std::size_t a, std::size_t b, const char *message) {
+    if (a != b) {
+        throw std::runtime_error(message);
+    }
+}
+
+void check_bounds(std::size_t i, std::size_t j, std::size_t size) {
+    if (i >= size || j >= size) {
+        throw std::out_of_range("Matrix index (" + std::to_string(i) + ", " + std::to_string(j) +
+                                ") out of bounds for size " + std::to_string(size));
+    }
+}
+
+// b's rows with their pending column swaps applied, so they can be read
+// as contiguous physical rows
+Matrix materialized(const Matrix &b) {
+    Matrix dense = b;
+    dense.materialize();
+    return dense;
+}
+
+// rows (or columns) of a structured operand expanded into a dense panel at
+// a time, so that its products with dense matrices run on gemm()
+constexpr std::size_t kPanelRows = 64;
+// bands at least this wide are multiplied panel by panel; narrower ones
+// waste most of a panel on zeros and are cheaper to walk row by row
+constexpr std::size_t kMinPanelBand = 32;
+
+std::size_t panel_count(std::size_t n) {
+    return (n + kPanelRows - 1) / kPanelRows;
+}
+
+// y[j] += x[j] over a band segment, for the band additions
+void add_row(std::size_t n, const int *x, int *y) {
+    for (std::size_t j = 0; j < n; ++j) {
+        y[j] = wrapping_add(y[j], x[j]);
+    }
+}
+
+// call swap(i, j) on positions until position i holds what started at
+// position target[i], at most N - 1 swaps
+template <typename Swap>
+void apply_permutation(const std::vector<std::size_t> &target, Swap swap) {
+    const std::size_t n = target.size();
+    std::vector<std::size_t> at(n), where(n);
+    std::iota(at.begin(), at.end(), std::size_t{0});
+    std::iota(where.begin(), where.end(), std::size_t{0});
+    for (std::size_t i = 0; i < n; ++i) {
+        const std::size_t j = where[target[i]];
+        if (j != i) {
+            swap(i, j);
+            std::swap(at[i], at[j]);
+            where[at[i]] = i;
+            where[at[j]] = j;
+        }
+    }
+}
+
+} // namespace
+
+BandMatrix::BandMatrix(std::size_t N, std::size_t lower, std::size_t upper)
+    : size_(N), lower_(N == 0 ? 0 : std::min(lower, N - 1)), upper_(N == 0 ? 0 : std::min(upper, N - 1)),
+      offsets_(N + 1, 0) {
+    for (std::size_t i = 0; i < N; ++i) {
+        offsets_[i + 1] = offsets_[i] + last_col(i) - first_col(i) + 1;
+    }
+    values_.assign(offsets_[N], 0);
+}
+
+BandMatrix::BandMatrix(const Matrix &dense, std::size_t lower, std::size_t upper)
+    : BandMatrix(dense.size(), lower, upper) {
+    const std::size_t n = size_;
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const Matrix::RowReader src = dense.row_reader(i);
+        for (std::size_t j = 0; j < n; ++j) {
+            if (j < first_col(i) || j > last_col(i)) {
+                if (src[j] != 0) {
+                    throw std::invalid_argument("Matrix element (" + std::to_string(i) + ", " + std::to_string(j) +
+                                                ") is nonzero outside the band");
+                }
+            } else {
+                row(i)[j - first_col(i)] = src[j];
+            }
+        }
+    }, grain_for(dense.stride()));
+}
+
+Matrix BandMatrix::to_dense() const {
+    Matrix result(size_);
+    const MatrixView out = result.view();
+    default_thread_pool().parallel_for(size_, [&](std::size_t i) {
+        std::copy(row(i), row(i) + row_width(i), out.row(i) + first_col(i));
+    }, grain_for(result.stride()));
+    return result;
+}
+
+void BandMatrix::check_index(std::size_t i, std::size_t j) const {
+    check_bounds(i, j, size_);
+}
+
+int BandMatrix::get_value(std::size_t i, std::size_t j) const {
+    check_index(i, j);
+    return j < first_col(i) || j > last_col(i) ? 0 : row(i)[j - first_col(i)];
+}
+
+void BandMatrix::set_value(std::size_t i, std::size_t j, int n) {
+    check_index(i, j);
+    if (j >= first_col(i) && j <= last_col(i)) {
+        row(i)[j - first_col(i)] = n;
+    } else if (n != 0) {
+        throw std::invalid_argument("Matrix element (" + std::to_string(i) + ", " + std::to_string(j) +
+                                    ") is outside the band");
+    }
+}
+
+int BandMatrix::sum_diagonal_major() const {
+    if (lower_ == 0 && upper_ == 0) {
+        return std::accumulate(values_.begin(), values_.end(), 0, wrapping_add<int>);
+    }
+    int sum = 0;
+    for (std::size_t i = 0; i < size_; ++i) {
+        sum = wrapping_add(sum, row(i)[i - first_col(i)]);
+    }
+    return sum;
+}
+
+int BandMatrix::sum_diagonal_minor() const {
+    int sum = 0;
+    for (std::size_t i = 0; i < size_; ++i) {
+        const std::size_t j = size_ - 1 - i;
+        if (j >= first_col(i) && j <= last_col(i)) {
+            sum = wrapping_add(sum, row(i)[j - first_col(i)]);
+        }
+    }
+    return sum;
+}
+
+BandMatrix operator+(const BandMatrix &a, const BandMatrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions must match for addition");
+    BandMatrix result(a.size(), std::max(a.lower(), b.lower()), std::max(a.upper(), b.upper()));
+    default_thread_pool().parallel_for(a.size(), [&](std::size_t i) {
+        int *c = result.row(i) - result.first_col(i);
+        add_row(a.row_width(i), a.row(i), c + a.first_col(i));
+        add_row(b.row_width(i), b.row(i), c + b.first_col(i));
+    }, grain_for(result.stored() / std::max<std::size_t>(1, a.size()) + 1));
+    return result;
+}
+
+Matrix operator+(const BandMatrix &a, const Matrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions must match for addition");
+    Matrix result = b;
+    const MatrixView out = result.view();
+    default_thread_pool().parallel_for(a.size(), [&](std::size_t i) {
+        add_row(a.row_width(i), a.row(i), out.row(i) + a.first_col(i));
+    }, grain_for(a.stored() / std::max<std::size_t>(1, a.size()) + 1));
+    return result;
+}
+
+Matrix operator+(const Matrix &a, const BandMatrix &b) {
+    return b + a;
+}
+
+BandMatrix operator*(const BandMatrix &a, const BandMatrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const std::size_t n = a.size();
+    // row i of C is the sum of A(i, k) * the stored part of row k of B,
+    // which lies inside row i's band of C
+    BandMatrix result(n, a.lower() + b.lower(), a.upper() + b.upper());
+    const AxpyFn axpy = axpy_kernel(gemm_isa());
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const int *arow = a.row(i);
+        int *c = result.row(i) - result.first_col(i);
+        for (std::size_t k = a.first_col(i); k <= a.last_col(i); ++k) {
+            const int v = arow[k - a.first_col(i)];
+            if (v != 0) {
+                axpy(b.row_width(k), v, b.row(k), c + b.first_col(k));
+            }
+        }
+    }, grain_for(a.stored() / std::max<std::size_t>(1, n) * (b.stored() / std::max<std::size_t>(1, n)) + 1));
+    return result;
+}
+
+Matrix operator*(const BandMatrix &a, const Matrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const Matrix dense = materialized(b);
+    const std::size_t n = a.size();
+    Matrix result(n);
+    const MatrixView out = result.view();
+
+    // a wide band: rows [i0, i0 + rows) of A, cut to the columns their band
+    // spans, times the rows of B facing those columns
+    if (a.lower() + a.upper() + 1 >= kMinPanelBand) {
+        const ConstMatrixView bv = dense.view();
+        default_thread_pool().parallel_for(panel_count(n), [&](std::size_t p) {
+            const std::size_t i0 = p * kPanelRows;
+            const std::size_t rows = std::min(kPanelRows, n - i0);
+            const std::size_t c0 = a.first_col(i0);
+            const std::size_t width = a.last_col(i0 + rows - 1) - c0 + 1;
+            std::vector<int> panel(rows * width, 0);
+            for (std::size_t r = 0; r < rows; ++r) {
+                const std::size_t i = i0 + r;
+                std::copy(a.row(i), a.row(i) + a.row_width(i), panel.data() + r * width + a.first_col(i) - c0);
+            }
+            gemm(ConstMatrixView{panel.data(), width}, bv.offset(c0, 0), out.offset(i0, 0), rows, n, width);
+        }, 1);
+        return result;
+    }
+
+    const AxpyFn axpy = axpy_kernel(gemm_isa());
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const int *arow = a.row(i);
+        int *c = out.row(i);
+        for (std::size_t k = a.first_col(i); k <= a.last_col(i); ++k) {
+            const int v = arow[k - a.first_col(i)];
+            if (v != 0) {
+                axpy(n, v, dense.row(k), c);
+            }
+        }
+    }, grain_for(dense.stride() * (a.stored() / std::max<std::size_t>(1, n) + 1)));
+    return result;
+}
+
+Matrix operator*(const Matrix &a, const BandMatrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const std::size_t n = a.size();
+    Matrix result(n);
+    const MatrixView out = result.view();
+
+    // a wide band: columns [j0, j0 + cols) of B, cut to the rows their band
+    // spans, times the columns of A facing those rows
+    if (b.lower() + b.upper() + 1 >= kMinPanelBand) {
+        const Matrix dense = materialized(a);
+        const ConstMatrixView av = dense.view();
+        default_thread_pool().parallel_for(panel_count(n), [&](std::size_t p) {
+            const std::size_t j0 = p * kPanelRows;
+            const std::size_t cols = std::min(kPanelRows, n - j0);
+            const std::size_t k0 = j0 > b.upper() ? j0 - b.upper() : 0;
+            const std::size_t k1 = std::min(n, j0 + cols + b.lower());
+            std::vector<int> panel((k1 - k0) * cols, 0);
+            for (std::size_t k = k0; k < k1; ++k) {
+                const std::size_t from = std::max(j0, b.first_col(k));
+                const std::size_t to = std::min(j0 + cols, b.last_col(k) + 1);
+                if (from < to) {
+                    const int *src = b.row(k) + (from - b.first_col(k));
+                    std::copy(src, src + (to - from), panel.data() + (k - k0) * cols + (from - j0));
+                }
+            }
+            gemm(av.offset(0, k0), ConstMatrixView{panel.data(), cols}, out.offset(0, j0), n, cols, k1 - k0);
+        }, 1);
+        return result;
+    }
+
+    const AxpyFn axpy = axpy_kernel(gemm_isa());
+    // row i of C is the sum of A(i, k) * row k of B, of which only the band
+    // segment is stored
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const Matrix::RowReader arow = a.row_reader(i);
+        int *c = out.row(i);
+        for (std::size_t k = 0; k < n; ++k) {
+            const int v = arow[k];
+            if (v != 0) {
+                axpy(b.row_width(k), v, b.row(k), c + b.first_col(k));
+            }
+        }
+    }, grain_for(a.stride() + b.stored()));
+    return result;
+}
+
+SymmetricMatrix::SymmetricMatrix(std::size_t N) : lower_(BandMatrix::lower_triangular(N)) {}
+
+SymmetricMatrix::SymmetricMatrix(const Matrix &dense) : SymmetricMatrix(dense.size()) {
+    const std::size_t n = size();
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        const Matrix::RowReader src = dense.row_reader(i);
+        int *dst = lower_.row(i);
+        for (std::size_t j = 0; j <= i; ++j) {
+            if (src[j] != dense.row_reader(j)[i]) {
+                throw std::invalid_argument("Matrix is not symmetric at (" + std::to_string(i) + ", " +
+                                            std::to_string(j) + ")");
+            }
+            dst[j] = src[j];
+        }
+    }, grain_for(dense.stride()));
+}
+
+Matrix SymmetricMatrix::to_dense() const {
+    const std::size_t n = size();
+    Matrix result(n);
+    const MatrixView out = result.view();
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        int *dst = out.row(i);
+        std::copy(lower_.row(i), lower_.row(i) + i + 1, dst);
+        for (std::size_t j = i + 1; j < n; ++j) {
+            dst[j] = lower_.row(j)[i];
+        }
+    }, grain_for(result.stride()));
+    return result;
+}
+
+int SymmetricMatrix::get_value(std::size_t i, std::size_t j) const {
+    return lower_.get_value(std::max(i, j), std::min(i, j));
+}
+
+void SymmetricMatrix::set_value(std::size_t i, std::size_t j, int n) {
+    lower_.set_value(std::max(i, j), std::min(i, j), n);
+}
+
+int SymmetricMatrix::sum_diagonal_minor() const {
+    // (i, N - 1 - i) mirrors (N - 1 - i, i), so the lower half is summed
+    // twice and a middle element once
+    const std::size_t n = size();
+    int sum = 0;
+    for (std::size_t i = (n + 1) / 2; i < n; ++i) {
+        sum = wrapping_madd(sum, 2, lower_.row(i)[n - 1 - i]);
+    }
+    if (n % 2 == 1) {
+        sum = wrapping_add(sum, lower_.row(n / 2)[n / 2]);
+    }
+    return sum;
+}
+
+SymmetricMatrix operator+(const SymmetricMatrix &a, const SymmetricMatrix &b) {
+    return SymmetricMatrix(a.lower() + b.lower());
+}
+
+Matrix operator+(const SymmetricMatrix &a, const Matrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions must match for addition");
+    const std::size_t n = a.size();
+    const BandMatrix &lower = a.lower();
+    Matrix result = b;
+    const MatrixView out = result.view();
+    default_thread_pool().parallel_for(n, [&](std::size_t i) {
+        int *c = out.row(i);
+        add_row(i + 1, lower.row(i), c);
+        for (std::size_t j = i + 1; j < n; ++j) {
+            c[j] = wrapping_add(c[j], lower.row(j)[i]);
+        }
+    }, grain_for(result.stride()));
+    return result;
+}
+
+Matrix operator+(const Matrix &a, const SymmetricMatrix &b) {
+    return b + a;
+}
+
+Matrix operator*(const SymmetricMatrix &a, const Matrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const Matrix dense = materialized(b);
+    const std::size_t n = a.size();
+    const BandMatrix &lower = a.lower();
+    Matrix result(n);
+    const MatrixView out = result.view();
+    const ConstMatrixView bv = dense.view();
+    // rows [i0, i0 + rows) of A in full: left of the diagonal from their own
+    // stored rows, right of it from the stored rows below, which hold
+    // columns i0 .. i0 + rows - 1 side by side
+    default_thread_pool().parallel_for(panel_count(n), [&](std::size_t p) {
+        const std::size_t i0 = p * kPanelRows;
+        const std::size_t rows = std::min(kPanelRows, n - i0);
+        std::vector<int> panel(rows * n);
+        for (std::size_t r = 0; r < rows; ++r) {
+            std::copy(lower.row(i0 + r), lower.row(i0 + r) + i0 + r + 1, panel.data() + r * n);
+        }
+        for (std::size_t j = i0 + 1; j < n; ++j) {
+            const int *src = lower.row(j) + i0;
+            for (std::size_t r = 0; r < std::min(rows, j - i0); ++r) {
+                panel[r * n + j] = src[r];
+            }
+        }
+        gemm(ConstMatrixView{panel.data(), n}, bv, out.offset(i0, 0), rows, n, n);
+    }, 1);
+    return result;
+}
+
+Matrix operator*(const Matrix &a, const SymmetricMatrix &b) {
+    check_sizes(a.size(), b.size(), "Matrix dimensions incompatible for multiplication");
+    const Matrix dense = materialized(a);
+    const std::size_t n = a.size();
+    const BandMatrix &lower = b.lower();
+    Matrix result(n);
+    const MatrixView out = result.view();
+    const ConstMatrixView av = dense.view();
+    // columns [j0, j0 + cols) of B in full. B(k, j) is stored row k for
+    // k >= j and row j (column k) above the diagonal
+    default_thread_pool().parallel_for(panel_count(n), [&](std::size_t p) {
+        const std::size_t j0 = p * kPanelRows;
+        const std::size_t cols = std::min(kPanelRows, n - j0);
+        std::vector<int> panel(n * cols);
+        for (std::size_t k = 0; k < n; ++k) {
+            int *dst = panel.data() + k * cols;
+            for (std::size_t c = 0; c < cols; ++c) {
+                const std::size_t j = j0 + c;
+                dst[c] = k >= j ? lower.row(k)[j] : lower.row(j)[k];
+            }
+        }
+        gemm(av, ConstMatrixView{panel.data(), cols}, out.offset(0, j0), n, cols, n);
+    }, 1);
+    return result;
+}
+
+Matrix operator*(const SymmetricMatrix &a, const SymmetricMatrix &b) {
+    return a * b.to_dense();
+}
+
+PermutationMatrix::PermutationMatrix(std::size_t N) : perm_(N) {
+    std::iota(perm_.begin(), perm_.end(), std::size_t{0});
+}
+
+PermutationMatrix::PermutationMatrix(std::vector<std::size_t> perm) : perm_(std::move(perm)) {
+    std::vector<char> seen(perm_.size(), 0);
+    for (std::size_t target : perm_) {
+        if (target >= perm_.size() || seen[target]) {
+            throw std::invalid_argument("Not a permutation of 0 .. " + std::to_string(perm_.size()) + " - 1");
+        }
+        seen[target] = 1;
+    }
+}
+
+PermutationMatrix::PermutationMatrix(const Matrix &dense) : perm_(dense.size(), dense.size()) {
+    const std::size_t n = dense.size();
+    std::vector<char> seen(n, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+        const Matrix::RowReader row = dense.row_reader(i);
+        for (std::size_t j = 0; j < n; ++j) {
+            const int v = row[j];
+            if (v == 0) {
+                continue;
+            }
+            if (v != 1 || perm_[i] != n || seen[j]) {
+                throw std::invalid_argument("Matrix is not a permutation matrix at (" + std::to_string(i) + ", " +
+                                            std::to_string(j) + ")");
+            }
+            perm_[i] = j;
+            seen[j] = 1;
+        }
+        if (perm_[i] == n) {
+            throw std::invalid_argument("Matrix is not a permutation matrix: row " + std::to_string(i) +
+                                        " has no 1");
+        }
+    }
+}
+
+Matrix PermutationMatrix::to_dense() const {
+    Matrix result(size());
+    for (std::size_t i = 0; i < size(); ++i) {
+        result.set_value(i, perm_[i], 1);
+    }
+    return result;
+}
+
+PermutationMatrix PermutationMatrix::inverse() const {
+    std::vector<std::size_t> inv(size());
+    for (std::size_t i = 0; i < size(); ++i) {
+        inv[perm_[i]] = i;
+    }
+    return PermutationMatrix(std::move(inv));
+}
+
+int PermutationMatrix::get_value(std::size_t i, std::size_t j) const {
+    check_bounds(i, j, size());
+    return perm_[i] == j ? 1 : 0;
+}
+
+int PermutationMatrix::sum_diagonal_major() const {
+    int sum = 0;
+    for (std::size_t i = 0; i < size(); ++i) {
+        sum += perm_[i] == i;
+    }
+    return sum;
+}
+
+int PermutationMatrix::sum_diagonal_minor() const {
+    int sum = 0;
+    for (std::size_t i = 0; i < size(); ++i) {
+        sum += perm_[i] == size() - 1 - i;
+    }
+    return sum;
+}
+
+Matrix operator+(const PermutationMatrix &p, const Matrix &a) {
+    check_sizes(p.size(), a.size(), "Matrix dimensions must match for addition");
+    Matrix result = a;
+    // view() applies any pending column swaps first, so perm indexes
+    // physical columns; one write per row, no bounds checks
+    const MatrixView out = result.view();
+    const std::vector<std::size_t> &perm = p.perm();
+    for (std::size_t i = 0; i < perm.size(); ++i) {
+        int &element = out.row(i)[perm[i]];
+        element = wrapping_add(element, 1);
+    }
+    return result;
+}
+
+Matrix operator+(const Matrix &a, const PermutationMatrix &p) {
+    return p + a;
+}
+
+Matrix operator*(const PermutationMatrix &p, const Matrix &a) {
+    check_sizes(p.size(), a.size(), "Matrix dimensions incompatible for multiplication");
+    Matrix result = a;
+    apply_permutation(p.perm(), [&result](std::size_t i, std::size_t j) { result.swap_rows(i, j); });
+    return result;
+}
+
+Matrix operator*(const Matrix &a, const PermutationMatrix &p) {
+    // column perm[k] of the result is column k of a
+    check_sizes(p.size(), a.size(), "Matrix dimensions incompatible for multiplication");
+    Matrix result = a;
+    apply_permutation(p.inverse().perm(), [&result](std::size_t i, std::size_t j) { result.swap_cols(i, j); });
+    return result;
+}
+
+PermutationMatrix operator*(const PermutationMatrix &p, const PermutationMatrix &q) {
+    check_sizes(p.size(), q.size(), "Matrix dimensions incompatible for multiplication");
+    std::vector<std::size_t> perm(p.size());
+    for (std::size_t i = 0; i < p.size(); ++i) {
+        perm[i] = q.perm()[p.perm()[i]];
+    }
+    return PermutationMatrix(std::move(perm));
+}
@@ -0,0 +1,171 @@
+#ifndef __STRUCTURED_MATRIX_HPP__
+#define __STRUCTURED_MATRIX_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+
+// square N x N int matrix whose nonzeros all lie in a band around the
+// diagonal: (i, j) can be nonzero only when i - lower <= j <= i + upper.
+// diagonal (lower = upper = 0), upper triangular (0, N - 1), lower
+// triangular (N - 1, 0) and banded matrices all have this shape. each row
+// stores just its columns inside the band, back to back, so a triangular
+// matrix takes N (N + 1) / 2 ints and a diagonal one N. the operations
+// below only visit stored elements: the zeros outside the band are never
+// read, added or multiplied. arithmetic wraps like Matrix.
+class BandMatrix {
+public:
+    // N x N zeros with the given bandwidths (clamped to N - 1)
+    explicit BandMatrix(std::size_t N = 0, std::size_t lower = 0, std::size_t upper = 0);
+    // the band of a dense matrix (through any pending column swaps). throws
+    // std::invalid_argument if the matrix has a nonzero outside it.
+    BandMatrix(const Matrix &dense, std::size_t lower, std::size_t upper);
+
+    static BandMatrix diagonal(std::size_t N) { return BandMatrix(N, 0, 0); }
+    static BandMatrix upper_triangular(std::size_t N) { return BandMatrix(N, 0, N); }
+    static BandMatrix lower_triangular(std::size_t N) { return BandMatrix(N, N, 0); }
+
+    Matrix to_dense() const;
+
+    std::size_t size() const { return size_; }
+    int get_size() const { return static_cast<int>(size_); }
+    std::size_t lower() const { return lower_; }
+    std::size_t upper() const { return upper_; }
+    // ints held, over all rows
+    std::size_t stored() const { return values_.size(); }
+
+    // row i holds columns first_col(i) .. last_col(i), starting at row(i)
+    std::size_t first_col(std::size_t i) const { return i > lower_ ? i - lower_ : 0; }
+    std::size_t last_col(std::size_t i) const { return std::min(size_ - 1, i + upper_); }
+    std::size_t row_width(std::size_t i) const { return offsets_[i + 1] - offsets_[i]; }
+    const int *row(std::size_t i) const { return values_.data() + offsets_[i]; }
+    int *row(std::size_t i) { return values_.data() + offsets_[i]; }
+
+    // bounds-checked like Matrix (std::out_of_range). elements outside the
+    // band read as zero; setting one to anything else throws
+    // std::invalid_argument.
+    int get_value(std::size_t i, std::size_t j) const;
+    void set_value(std::size_t i, std::size_t j, int n);
+
+    // O(N) reads at known offsets; a diagonal matrix stores nothing but its
+    // diagonal, so the major sum is a single pass over its values
+    int sum_diagonal_major() const;
+    int sum_diagonal_minor() const;
+
+private:
+    void check_index(std::size_t i, std::size_t j) const;
+
+    std::size_t size_;
+    std::size_t lower_;
+    std::size_t upper_;
+    std::vector<std::size_t> offsets_;
+    std::vector<int> values_;
+};
+
+// the sum of two band matrices is banded with the wider of each bandwidth,
+// and their product with the bandwidths added (clamped to N - 1), so
+// diagonal and same-sided triangular operands keep their structure. a
+// product with a dense matrix costs O(N * stored()) instead of O(N^3):
+// narrow bands add one row of B (or a band segment of one) per stored
+// element, and bands 32 or more wide are expanded 64 rows (or columns) at
+// a time into just the columns (rows) their band spans and handed to
+// gemm(). throws std::runtime_error with operator+ / operator*'s messages
+// if the sizes differ.
+BandMatrix operator+(const BandMatrix &a, const BandMatrix &b);
+Matrix operator+(const BandMatrix &a, const Matrix &b);
+Matrix operator+(const Matrix &a, const BandMatrix &b);
+BandMatrix operator*(const BandMatrix &a, const BandMatrix &b);
+Matrix operator*(const BandMatrix &a, const Matrix &b);
+Matrix operator*(const Matrix &a, const BandMatrix &b);
+
+// square N x N int matrix equal to its own transpose. only the lower
+// triangle is stored (as a lower triangular BandMatrix, N (N + 1) / 2
+// ints); (i, j) and (j, i) are one element.
+class SymmetricMatrix {
+public:
+    explicit SymmetricMatrix(std::size_t N = 0);
+    // throws std::invalid_argument if dense is not symmetric
+    explicit SymmetricMatrix(const Matrix &dense);
+
+    Matrix to_dense() const;
+
+    std::size_t size() const { return lower_.size(); }
+    int get_size() const { return lower_.get_size(); }
+    // the stored triangle
+    const BandMatrix &lower() const { return lower_; }
+
+    // bounds-checked like Matrix (std::out_of_range); set_value() writes
+    // both (i, j) and (j, i)
+    int get_value(std::size_t i, std::size_t j) const;
+    void set_value(std::size_t i, std::size_t j, int n);
+
+    int sum_diagonal_major() const { return lower_.sum_diagonal_major(); }
+    int sum_diagonal_minor() const;
+
+private:
+    explicit SymmetricMatrix(BandMatrix lower) : lower_(std::move(lower)) {}
+
+    friend SymmetricMatrix operator+(const SymmetricMatrix &a, const SymmetricMatrix &b);
+
+    BandMatrix lower_;
+};
+
+// sums of symmetric matrices stay symmetric; products do not, and are
+// dense. a product with a dense matrix expands 64 rows (or columns) of the
+// symmetric factor at a time from the stored triangle and hands them to
+// gemm(), so the full matrix never exists at once. throws
+// std::runtime_error like operator+ / operator* if the sizes differ.
+SymmetricMatrix operator+(const SymmetricMatrix &a, const SymmetricMatrix &b);
+Matrix operator+(const SymmetricMatrix &a, const Matrix &b);
+Matrix operator+(const Matrix &a, const SymmetricMatrix &b);
+Matrix operator*(const SymmetricMatrix &a, const Matrix &b);
+Matrix operator*(const Matrix &a, const SymmetricMatrix &b);
+Matrix operator*(const SymmetricMatrix &a, const SymmetricMatrix &b);
+
+// N x N matrix with a single 1 in every row and column, row i's in column
+// perm()[i], held as the permutation alone. multiplying by one moves rows
+// or columns instead of doing arithmetic: P * A takes row i from row
+// perm[i] of A, and A * P moves column k to column perm[k]. both are done
+// with Matrix's O(1) row and column swaps, so they cost O(N) and share A's
+// storage until it is written.
+class PermutationMatrix {
+public:
+    // the identity
+    explicit PermutationMatrix(std::size_t N = 0);
+    // throws std::invalid_argument unless perm holds each of 0 .. N - 1 once
+    explicit PermutationMatrix(std::vector<std::size_t> perm);
+    // throws std::invalid_argument unless dense is all zeros except for one
+    // 1 in every row and column
+    explicit PermutationMatrix(const Matrix &dense);
+
+    Matrix to_dense() const;
+    PermutationMatrix inverse() const;
+
+    std::size_t size() const { return perm_.size(); }
+    int get_size() const { return static_cast<int>(perm_.size()); }
+    const std::vector<std::size_t> &perm() const { return perm_; }
+
+    // bounds-checked like Matrix (std::out_of_range)
+    int get_value(std::size_t i, std::size_t j) const;
+
+    // the fixed points, and the rows mapped to their mirror column
+    int sum_diagonal_major() const;
+    int sum_diagonal_minor() const;
+
+private:
+    std::vector<std::size_t> perm_;
+};
+
+// P + A adds one to N elements of a copy of A; the products are
+// described above, and P * Q composes the permutations. throws
+// std::runtime_error like operator+ / operator* if the sizes differ.
+Matrix operator+(const PermutationMatrix &p, const Matrix &a);
+Matrix operator+(const Matrix &a, const PermutationMatrix &p);
+Matrix operator*(const PermutationMatrix &p, const Matrix &a);
+Matrix operator*(const Matrix &a, const PermutationMatrix &p);
+PermutationMatrix operator*(const PermutationMatrix &p, const PermutationMatrix &q);
+
+#endif // __STRUCTURED_MATRIX_HPP__
@@ -1,6 +1,111 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <random>
+#include <utility>
+
+#include "accumulation.hpp"
+#include "adaptive_matrix.hpp"
+#include "batch.hpp"
+#include "fixed_matrix.hpp"
+#include "gemm.hpp"
 #include "matrix.hpp"
+#include "matrix_batch.hpp"
+#include "matrix_binary.hpp"
+#include "matrix_io.hpp"
+#include "matrix_writer.hpp"
+#include "out_of_core.hpp"
+#include "scratch_arena.hpp"
+#include "sparse_matrix.hpp"
+#include "strassen.hpp"
+#include "structured_matrix.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+std::vector<std::vector<int>> random_values(std::size_t n, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dist(-50, 50);
+    std::vector<std::vector<int>> values(n, std::vector<int>(n));
+    for (auto &row : values) {
+        for (auto &value : row) {
+            value = dist(gen);
+        }
+    }
+    return values;
+}
+
+std::vector<std::vector<int>> reference_multiply(const std::vector<std::vector<int>> &a,
+                                                 const std::vector<std::vector<int>> &b) {
+    std::size_t n = a.size();
+    std::vector<std::vector<int>> c(n, std::vector<int>(n, 0));
+    for (std::size_t i = 0; i < n; i++) {
+        for (std::size_t j = 0; j < n; j++) {
+            for (std::size_t k = 0; k < n; k++) {
+                c[i][j] += a[i][k] * b[k][j];
+            }
+        }
+    }
+    return c;
+}
+
+void expect_matrix_eq(const Matrix &matrix, const std::vector<std::vector<int>> &expected) {
+    ASSERT_EQ(matrix.get_size(), static_cast<int>(expected.size()));
+    for (std::size_t i = 0; i < expected.size(); i++) {
+        for (std::size_t j = 0; j < expected.size(); j++) {
+            EXPECT_EQ(matrix.get_value(i, j), expected[i][j]) << "at [" << i << "][" << j << "]";
+        }
+    }
+}
+
+std::string write_temp_file(const std::string &name, const std::string &contents) {
+    std::string path = testing::TempDir() + name;
+    std::ofstream out(path, std::ios::binary);
+    out << contents;
+    return path;
+}
+
+// (A + B) * C for element type T against a reference computed in long long
+// and narrowed the way T's arithmetic wraps, under every supported ISA
+template <typename T>
+void expect_typed_product(std::size_t n) {
+    const auto a = random_values(n, 61), b = random_values(n, 62), c = random_values(n, 63);
+    auto convert = [](const std::vector<std::vector<int>> &values) {
+        std::vector<std::vector<T>> out(values.size());
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            out[i].assign(values[i].begin(), values[i].end());
+        }
+        return out;
+    };
+    const BasicMatrix<T> ma(convert(a)), mb(convert(b)), mc(convert(c));
+
+    GemmIsa saved = gemm_isa();
+    for (GemmIsa isa : {GemmIsa::scalar, GemmIsa::avx2, GemmIsa::avx512}) {
+        if (!gemm_isa_supported(isa)) {
+            continue;
+        }
+        set_gemm_isa(isa);
+        const BasicMatrix<T> product = (ma + mb) * mc;
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                long long expected = 0;
+                for (std::size_t k = 0; k < n; ++k) {
+                    expected += static_cast<long long>(static_cast<T>(a[i][k] + b[i][k])) * c[k][j];
+                }
+                ASSERT_EQ(product.get_value(i, j), static_cast<T>(expected)) << "at [" << i << "][" << j << "]";
+            }
+        }
+    }
+    set_gemm_isa(saved);
+}
+
+} // namespace
 
 TEST(MatrixImplementation, GetSize_3) {
     Matrix matrix({
@@ -329,4 +434,1269 @@ TEST(MatrixImplementation, OutOfBoundsThrowsException) {
     });
 
     EXPECT_THROW(matrix.get_value(4, 4), std::out_of_range);
-}
\ No newline at end of file
+}
+TEST(MatrixImplementation, RowsAreCacheLineAligned) {
+    Matrix matrix(5);
+
+    EXPECT_GE(matrix.stride(), 5u);
+    for (int i = 0; i < matrix.get_size(); i++) {
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(matrix.row(i)) % 64, 0u);
+    }
+    EXPECT_EQ(matrix.row(1) - matrix.row(0), static_cast<std::ptrdiff_t>(matrix.stride()));
+}
+
+TEST(MatrixGemm, TiledMatchesReference) {
+    auto a = random_values(37, 1);
+    auto b = random_values(37, 2);
+    auto expected = reference_multiply(a, b);
+
+    GemmTuning saved = gemm_tuning();
+    GemmTuning small;
+    small.mc = 5;
+    small.kc = 7;
+    small.nc = 11;
+    set_gemm_tuning(small);
+    Matrix result = Matrix(a) * Matrix(b);
+    set_gemm_tuning(saved);
+
+    expect_matrix_eq(result, expected);
+}
+
+TEST(MatrixGemm, OddTilesOnEveryIsa) {
+    // packed B sizes that are not whole cache lines, on every kernel. ctest
+    // runs each test in its own process, so the scratch arenas start empty.
+    GemmTuning saved = gemm_tuning();
+    GemmTuning odd;
+    odd.mc = 4;
+    odd.kc = 3;
+    odd.nc = 8;
+    const auto x = random_values(5, 8), y = random_values(5, 9);
+    const auto xy = reference_multiply(x, y);
+    BasicMatrix<std::int8_t> x8(5), y8(5);
+    for (std::size_t i = 0; i < 5; ++i) {
+        for (std::size_t j = 0; j < 5; ++j) {
+            x8.set_value(i, j, static_cast<std::int8_t>(x[i][j] % 8));
+            y8.set_value(i, j, static_cast<std::int8_t>(y[i][j] % 8));
+        }
+    }
+    GemmIsa saved_isa = gemm_isa();
+    set_gemm_tuning(odd);
+    for (GemmIsa isa : {GemmIsa::scalar, GemmIsa::avx2, GemmIsa::avx512}) {
+        if (!gemm_isa_supported(isa)) {
+            continue;
+        }
+        set_gemm_isa(isa);
+        expect_matrix_eq(Matrix(x) * Matrix(y), xy);
+        const BasicMatrix<std::int8_t> narrow = x8 * y8;
+        for (std::size_t i = 0; i < 5; ++i) {
+            for (std::size_t j = 0; j < 5; ++j) {
+                int exact = 0;
+                for (std::size_t k = 0; k < 5; ++k) {
+                    exact += x8.get_value(i, k) * y8.get_value(k, j);
+                }
+                EXPECT_EQ(narrow.get_value(i, j), static_cast<std::int8_t>(exact));
+            }
+        }
+    }
+    set_gemm_isa(saved_isa);
+    set_gemm_tuning(saved);
+}
+
+TEST(MatrixGemm, ArenaReservationCoversRoundedTakes) {
+    ScratchArena arena;
+    arena.reserve(ScratchArena::ints_for<std::int64_t>(3) + ScratchArena::ints_for<std::int8_t>(5));
+    EXPECT_NO_THROW(arena.take_as<std::int64_t>(3));
+    EXPECT_NO_THROW(arena.take_as<std::int8_t>(5));
+    EXPECT_THROW(arena.take(1), std::length_error);
+}
+
+TEST(MatrixGemm, RejectsZeroBlockSize) {
+    GemmTuning tuning;
+    tuning.kc = 0;
+    EXPECT_THROW(set_gemm_tuning(tuning), std::invalid_argument);
+}
+
+TEST(MatrixGemm, EveryIsaMatchesReference) {
+    auto a = random_values(45, 3);
+    auto b = random_values(45, 4);
+    auto expected = reference_multiply(a, b);
+
+    GemmIsa saved = gemm_isa();
+    for (GemmIsa isa : {GemmIsa::scalar, GemmIsa::avx2, GemmIsa::avx512}) {
+        if (!gemm_isa_supported(isa)) {
+            EXPECT_THROW(set_gemm_isa(isa), std::invalid_argument);
+            continue;
+        }
+        set_gemm_isa(isa);
+        expect_matrix_eq(Matrix(a) * Matrix(b), expected);
+    }
+    set_gemm_isa(saved);
+}
+
+TEST(MatrixThreads, ParallelMultiplyMatchesReference) {
+    auto a = random_values(70, 5);
+    auto b = random_values(70, 6);
+    auto expected = reference_multiply(a, b);
+
+    std::size_t saved = thread_count();
+    set_thread_count(4);
+    EXPECT_EQ(thread_count(), 4u);
+    expect_matrix_eq(Matrix(a) * Matrix(b), expected);
+    set_thread_count(saved);
+}
+
+TEST(MatrixThreads, ParallelForVisitsEveryIndexOnce) {
+    ThreadPool pool(3);
+    std::vector<int> hits(100, 0);
+    pool.parallel_for(hits.size(), [&](std::size_t i) { hits[i]++; });
+    for (int h : hits) {
+        EXPECT_EQ(h, 1);
+    }
+    EXPECT_THROW(pool.parallel_for(10, [](std::size_t i) {
+        if (i == 7) {
+            throw std::runtime_error("boom");
+        }
+    }), std::runtime_error);
+}
+
+TEST(MatrixThreads, NestedParallelForDoesNotDeadlock) {
+    ThreadPool pool(4);
+    std::atomic<int> total{0};
+    pool.parallel_for(8, [&](std::size_t) {
+        pool.parallel_for(50, [&](std::size_t) { total++; }, 1);
+    }, 1);
+    EXPECT_EQ(total.load(), 400);
+}
+
+TEST(MatrixThreads, TaskGroupRunsEveryTask) {
+    ThreadPool pool(3);
+    std::atomic<int> total{0};
+    TaskGroup group(pool);
+    for (int i = 1; i <= 20; i++) {
+        group.run([&total, i] { total += i; });
+    }
+    group.wait();
+    EXPECT_EQ(total.load(), 210);
+}
+
+TEST(MatrixStrassen, MatchesReferenceWithPadding) {
+    std::size_t saved = strassen_crossover();
+    set_strassen_crossover(8);
+    for (std::size_t n : {37u, 64u}) {
+        auto a = random_values(n, 7);
+        auto b = random_values(n, 8);
+        expect_matrix_eq(Matrix(a) * Matrix(b), reference_multiply(a, b));
+    }
+    set_strassen_crossover(saved);
+}
+
+TEST(MatrixExpressions, ChainedSumEvaluatesInOnePass) {
+    Matrix a(random_values(9, 10));
+    Matrix b(random_values(9, 11));
+    Matrix c(random_values(9, 12));
+
+    auto expr = a + b + c;
+    Matrix result = expr;
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 9; j++) {
+            int expected = a.get_value(i, j) + b.get_value(i, j) + c.get_value(i, j);
+            EXPECT_EQ(expr.get_value(i, j), expected);
+            EXPECT_EQ(result.get_value(i, j), expected);
+        }
+    }
+}
+
+TEST(MatrixExpressions, TemporariesAreHeldByValue) {
+    auto a = random_values(6, 13);
+    auto b = random_values(6, 14);
+    auto expr = Matrix(a) + Matrix(b);
+
+    Matrix result = expr;
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 6; j++) {
+            EXPECT_EQ(result.get_value(i, j), a[i][j] + b[i][j]);
+        }
+    }
+}
+
+TEST(MatrixExpressions, SumFusedIntoMultiply) {
+    auto a = random_values(23, 15);
+    auto b = random_values(23, 16);
+    auto c = random_values(23, 17);
+    auto ab = a;
+    for (int i = 0; i < 23; i++) {
+        for (int j = 0; j < 23; j++) {
+            ab[i][j] += b[i][j];
+        }
+    }
+
+    Matrix ma(a), mb(b), mc(c);
+    expect_matrix_eq((ma + mb) * mc, reference_multiply(ab, c));
+    expect_matrix_eq(mc * (ma + mb), reference_multiply(c, ab));
+
+    // more terms than GemmOperand can hold falls back to materializing
+    auto many = a;
+    for (int i = 0; i < 23; i++) {
+        for (int j = 0; j < 23; j++) {
+            many[i][j] = 5 * a[i][j] + 4 * b[i][j];
+        }
+    }
+    expect_matrix_eq((ma + mb + ma + mb + ma + mb + ma + mb + ma) * mc, reference_multiply(many, c));
+}
+
+TEST(MatrixExpressions, MismatchedSizesThrow) {
+    Matrix a(3), b(4);
+    EXPECT_THROW(a + b, std::runtime_error);
+    EXPECT_THROW(a * b, std::runtime_error);
+}
+
+TEST(MatrixInPlace, MoveLeavesSourceEmpty) {
+    Matrix a(random_values(5, 18));
+    const int *buffer = a.row(0);
+    Matrix b(std::move(a));
+
+    EXPECT_EQ(b.row(0), buffer);
+    EXPECT_EQ(a.get_size(), 0);
+    a = std::move(b);
+    EXPECT_EQ(a.row(0), buffer);
+    EXPECT_EQ(b.get_size(), 0);
+}
+
+TEST(MatrixInPlace, CompoundOperatorsMatchReference) {
+    auto a = random_values(19, 19);
+    auto b = random_values(19, 20);
+
+    Matrix sum(a);
+    sum += Matrix(b);
+    for (int i = 0; i < 19; i++) {
+        for (int j = 0; j < 19; j++) {
+            EXPECT_EQ(sum.get_value(i, j), a[i][j] + b[i][j]);
+        }
+    }
+
+    Matrix product(a);
+    product *= Matrix(b);
+    expect_matrix_eq(product, reference_multiply(a, b));
+
+    Matrix square(a);
+    square *= square;
+    expect_matrix_eq(square, reference_multiply(a, a));
+}
+
+TEST(MatrixInPlace, IntoFormsReuseDestination) {
+    auto a = random_values(12, 21);
+    auto b = random_values(12, 22);
+    Matrix ma(a), mb(b), dst(12);
+    const int *buffer = dst.row(0);
+
+    add_into(dst, ma, mb);
+    EXPECT_EQ(dst.row(0), buffer);
+    EXPECT_EQ(dst.get_value(3, 4), a[3][4] + b[3][4]);
+
+    multiply_into(dst, ma, mb);
+    EXPECT_EQ(dst.row(0), buffer);
+    expect_matrix_eq(dst, reference_multiply(a, b));
+}
+
+TEST(MatrixSnapshots, CopySharesUntilWritten) {
+    auto values = random_values(150, 23);
+    Matrix original(values);
+    Matrix snapshot = original;
+    const Matrix &o = original;
+    const Matrix &s = snapshot;
+    EXPECT_TRUE(s.shares_storage_with(o));
+    EXPECT_EQ(s.row(0), o.row(0));
+
+    snapshot.set_value(100, 5, 12345);
+    EXPECT_EQ(o.get_value(100, 5), values[100][5]);
+    EXPECT_EQ(s.get_value(100, 5), 12345);
+    // only the panel holding row 100 was copied
+    EXPECT_EQ(s.row(0), o.row(0));
+    EXPECT_NE(s.row(100), o.row(100));
+}
+
+TEST(MatrixSnapshots, SwapsAndProductsLeaveSnapshotIntact) {
+    auto a = random_values(20, 24);
+    auto b = random_values(20, 25);
+    Matrix ma(a);
+    Matrix rows = ma;
+    Matrix cols = ma;
+    rows.swap_rows(0, 1);
+    cols.swap_cols(1, 2);
+    expect_matrix_eq(ma, a);
+    EXPECT_EQ(rows.get_value(0, 3), a[1][3]);
+    EXPECT_EQ(cols.get_value(4, 1), a[4][2]);
+
+    Matrix product = ma;
+    product *= Matrix(b);
+    expect_matrix_eq(ma, a);
+    expect_matrix_eq(product, reference_multiply(a, b));
+}
+
+TEST(MatrixPermutations, SwapsAreRecordedNotCopied) {
+    auto values = random_values(10, 26);
+    Matrix matrix(values);
+    const Matrix &view = matrix;
+    const int *row0 = view.row(0);
+    const int *row7 = view.row(7);
+
+    matrix.swap_rows(0, 7);
+    matrix.swap_cols(2, 5);
+    matrix.swap_cols(5, 9);
+    EXPECT_EQ(view.row(0), row7);
+    EXPECT_EQ(view.row(7), row0);
+    EXPECT_TRUE(matrix.has_column_permutation());
+
+    std::swap(values[0], values[7]);
+    for (auto &row : values) {
+        std::swap(row[2], row[5]);
+        std::swap(row[5], row[9]);
+    }
+    expect_matrix_eq(matrix, values);
+
+    matrix.materialize();
+    EXPECT_FALSE(matrix.has_column_permutation());
+    expect_matrix_eq(matrix, values);
+}
+
+TEST(MatrixPermutations, KernelsSeePermutedOperands) {
+    auto a = random_values(17, 27);
+    auto b = random_values(17, 28);
+    Matrix ma(a), mb(b);
+    ma.swap_cols(0, 16);
+    ma.swap_rows(3, 4);
+    mb.swap_cols(1, 2);
+    for (auto &row : a) {
+        std::swap(row[0], row[16]);
+    }
+    std::swap(a[3], a[4]);
+    for (auto &row : b) {
+        std::swap(row[1], row[2]);
+    }
+
+    expect_matrix_eq(ma * mb, reference_multiply(a, b));
+    Matrix sum = ma + mb;
+    EXPECT_EQ(sum.get_value(3, 0), a[3][0] + b[3][0]);
+    int major = 0;
+    for (int i = 0; i < 17; i++) {
+        major += a[i][i];
+    }
+    EXPECT_EQ(ma.sum_diagonal_major(), major);
+
+    ma.set_value(5, 0, 777);
+    EXPECT_EQ(ma.get_value(5, 0), 777);
+    EXPECT_EQ(ma.get_value(5, 16), a[5][16]);
+}
+
+TEST(MatrixLoader, ReadsZeroPaddedValues) {
+    std::string path = write_temp_file("loader_ok.txt",
+                                       "2\n01 02\n  -03 +04\n\n10\t20\r\n30 040\n");
+    Matrix a(0), b(0);
+    load_matrices(path, a, b);
+
+    expect_matrix_eq(a, {{1, 2}, {-3, 4}});
+    expect_matrix_eq(b, {{10, 20}, {30, 40}});
+}
+
+TEST(MatrixLoader, ReportsFailingElement) {
+    Matrix a(0), b(0);
+    std::string truncated = write_temp_file("loader_short.txt", "2\n1 2 3 4\n5 6 x 8\n");
+    try {
+        load_matrices(truncated, a, b);
+        FAIL() << "expected load_matrices to throw";
+    } catch (const std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), "Failed to read element for Matrix B at [1][0]");
+    }
+
+    std::string bad_size = write_temp_file("loader_size.txt", "-3\n");
+    EXPECT_THROW(load_matrices(bad_size, a, b), std::runtime_error);
+    EXPECT_THROW(load_matrices(testing::TempDir() + "does_not_exist.txt", a, b), std::runtime_error);
+}
+
+TEST(MatrixLoader, TokensSpanningBufferRefills) {
+    std::string contents = "3\n";
+    for (int v = 0; v < 18; v++) {
+        contents += std::to_string(1000 + v) + (v % 3 == 2 ? "\n" : "   ");
+    }
+    std::string path = write_temp_file("loader_refill.txt", contents);
+
+    IntReader reader(path, 64);
+    int value = 0;
+    ASSERT_TRUE(reader.next(value));
+    EXPECT_EQ(value, 3);
+    for (int v = 0; v < 18; v++) {
+        ASSERT_TRUE(reader.next(value));
+        EXPECT_EQ(value, 1000 + v);
+    }
+    EXPECT_FALSE(reader.next(value));
+}
+
+TEST(MatrixLoader, MappedMatchesBuffered) {
+    std::string path = write_temp_file("loader_mapped.txt", "3\n01 02 03\n04 05 06\n07 08 09\n"
+                                                            "-1 -2 -3\n-4 -5 -6\n-7 -8 -9");
+    Matrix a(0), b(0), ma(0), mb(0);
+    load_matrices(path, a, b);
+    load_matrices_mapped(path, ma, mb);
+    expect_matrix_eq(ma, {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
+    expect_matrix_eq(mb, {{-1, -2, -3}, {-4, -5, -6}, {-7, -8, -9}});
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            EXPECT_EQ(a.get_value(i, j), ma.get_value(i, j));
+            EXPECT_EQ(b.get_value(i, j), mb.get_value(i, j));
+        }
+    }
+
+    std::string truncated = write_temp_file("loader_mapped_short.txt", "2\n1 2 3");
+    try {
+        load_matrices_mapped(truncated, a, b);
+        FAIL() << "expected load_matrices_mapped to throw";
+    } catch (const std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), "Failed to read element for Matrix A at [1][1]");
+    }
+    EXPECT_THROW(load_matrices_mapped(write_temp_file("loader_empty.txt", ""), a, b), std::runtime_error);
+}
+
+TEST(MatrixLoader, ParallelMatchesSequentialAcrossChunks) {
+    const int n = 300;
+    std::mt19937 gen(29);
+    std::uniform_int_distribution<int> dist(-99999, 99999);
+    std::string contents = std::to_string(n) + "\n";
+    std::vector<int> values;
+    for (int v = 0; v < 2 * n * n; v++) {
+        values.push_back(dist(gen));
+        contents += std::to_string(values.back()) + ((v + 1) % n == 0 ? "\n" : " ");
+    }
+    std::string path = write_temp_file("loader_parallel.txt", contents);
+
+    std::size_t saved = thread_count();
+    set_thread_count(4);
+    Matrix a(0), b(0);
+    load_matrices_parallel(path, a, b);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            ASSERT_EQ(a.get_value(i, j), values[i * n + j]);
+            ASSERT_EQ(b.get_value(i, j), values[n * n + i * n + j]);
+        }
+    }
+
+    // two bad tokens far apart: the earlier one is reported
+    std::string broken = contents;
+    broken[broken.size() - 20] = 'x';
+    broken[broken.find(' ', 1000) + 1] = 'y';
+    std::string broken_path = write_temp_file("loader_parallel_bad.txt", broken);
+    std::string sequential_error;
+    try {
+        load_matrices(broken_path, a, b);
+    } catch (const std::runtime_error &e) {
+        sequential_error = e.what();
+    }
+    try {
+        load_matrices_parallel(broken_path, a, b);
+        FAIL() << "expected load_matrices_parallel to throw";
+    } catch (const std::runtime_error &e) {
+        EXPECT_EQ(sequential_error, e.what());
+    }
+    set_thread_count(saved);
+}
+
+TEST(MatrixLoader, ParallelReportsMissingAndTrailingGarbage) {
+    Matrix a(0), b(0);
+    try {
+        load_matrices_parallel(write_temp_file("loader_parallel_short.txt", "2\n1 2 3 4 5"), a, b);
+        FAIL() << "expected load_matrices_parallel to throw";
+    } catch (const std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), "Failed to read element for Matrix B at [0][1]");
+    }
+    try {
+        load_matrices_parallel(write_temp_file("loader_parallel_glued.txt", "2\n1 2 3 4 5 6x 7 8"), a, b);
+        FAIL() << "expected load_matrices_parallel to throw";
+    } catch (const std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), "Failed to read element for Matrix B at [1][0]");
+    }
+    // numbers glued by a sign are separate elements, as for `>>`
+    const std::string glued = write_temp_file("loader_parallel_signs.txt", "2\n1 2-3 4 5 6+7-8");
+    Matrix seq_a(0), seq_b(0);
+    load_matrices(glued, seq_a, seq_b);
+    load_matrices_parallel(glued, a, b);
+    EXPECT_EQ(a.get_value(0, 1), 2);
+    EXPECT_EQ(a.get_value(1, 0), -3);
+    EXPECT_EQ(b.get_value(1, 1), -8);
+    for (std::size_t i = 0; i < 2; ++i) {
+        for (std::size_t j = 0; j < 2; ++j) {
+            EXPECT_EQ(a.get_value(i, j), seq_a.get_value(i, j));
+            EXPECT_EQ(b.get_value(i, j), seq_b.get_value(i, j));
+        }
+    }
+    load_matrices_parallel(write_temp_file("loader_parallel_tail.txt", "1\n7 8x"), a, b);
+    EXPECT_EQ(b.get_value(0, 0), 8);
+}
+
+TEST(MatrixLoader, AsyncHandsOutAWhenOnlyBIsBroken) {
+    const int n = 300;
+    std::string contents = std::to_string(n) + "\n";
+    for (int v = 0; v < 2 * n * n; v++) {
+        contents += std::to_string(v % 1000) + ((v + 1) % n == 0 ? "\n" : " ");
+    }
+    std::size_t saved = thread_count();
+    set_thread_count(4);
+
+    AsyncMatrixLoad good(write_temp_file("loader_async.txt", contents));
+    EXPECT_EQ(good.a().get_value(n - 1, n - 1), (n * n - 1) % 1000);
+    EXPECT_EQ(good.b().get_value(0, 0), (n * n) % 1000);
+
+    // a bad token late in B fails B only; one in A fails both
+    std::string broken_b = contents;
+    broken_b[broken_b.size() - 4] = 'x';
+    AsyncMatrixLoad late(write_temp_file("loader_async_b.txt", broken_b));
+    EXPECT_EQ(late.a().get_value(5, 7), (5 * n + 7) % 1000);
+    EXPECT_THROW(late.b(), std::runtime_error);
+
+    std::string broken_a = contents;
+    broken_a[10] = 'x';
+    AsyncMatrixLoad early(write_temp_file("loader_async_a.txt", broken_a));
+    EXPECT_THROW(early.a(), std::runtime_error);
+    EXPECT_THROW(early.b(), std::runtime_error);
+    set_thread_count(saved);
+}
+
+TEST(MatrixBinary, RoundTripWrapsMappedPayload) {
+    auto a_values = random_values(70, 21);
+    auto b_values = random_values(70, 22);
+    Matrix a(a_values), b(b_values);
+    // pending swaps are written out in logical order
+    a.swap_rows(0, 69);
+    a.swap_cols(3, 4);
+    std::swap(a_values[0], a_values[69]);
+    for (auto &row : a_values) {
+        std::swap(row[3], row[4]);
+    }
+
+    const std::string path = testing::TempDir() + "binary_roundtrip.bin";
+    save_matrices_binary(path, a, b);
+    EXPECT_TRUE(is_binary_matrix_file(path));
+    const BinaryMatrixHeader header = read_binary_header(path);
+    EXPECT_EQ(header.n, 70u);
+    EXPECT_EQ(header.count, 2u);
+    EXPECT_EQ(header.row_stride, Matrix::stride_for(70));
+
+    Matrix la(0), lb(0);
+    load_matrices_binary(path, la, lb);
+    expect_matrix_eq(la, a_values);
+    expect_matrix_eq(lb, b_values);
+    expect_matrix_eq(la * lb, reference_multiply(a_values, b_values));
+
+    // writes stay private to the loaded matrix
+    la.set_value(5, 5, 12345);
+    Matrix again_a(0), again_b(0);
+    load_matrices_binary(path, again_a, again_b);
+    EXPECT_EQ(again_a.get_value(5, 5), a_values[5][5]);
+    expect_matrix_eq(lb, b_values);
+}
+
+TEST(MatrixBinary, ConvertsTextAndRejectsBadFiles) {
+    const std::string text = write_temp_file("binary_source.txt", "3\n1 2 3\n4 5 6\n7 8 9\n9 8 7\n6 5 4\n3 2 1\n");
+    const std::string path = testing::TempDir() + "binary_converted.bin";
+    convert_text_to_binary(text, path);
+    EXPECT_FALSE(is_binary_matrix_file(text));
+
+    Matrix a(0), b(0);
+    load_matrices_binary(path, a, b);
+    expect_matrix_eq(a, {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
+    expect_matrix_eq(b, {{9, 8, 7}, {6, 5, 4}, {3, 2, 1}});
+
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const std::string truncated = write_temp_file("binary_truncated.bin", bytes.substr(0, bytes.size() - 4));
+    EXPECT_THROW(load_matrices_binary(truncated, a, b), std::runtime_error);
+    EXPECT_THROW(load_matrices_binary(text, a, b), std::runtime_error);
+}
+
+TEST(MatrixWriter, AlignedMatchesSetwLayout) {
+    // 600 x 600 goes through the parallel formatter, 3 x 3 through the block
+    for (std::size_t n : {3u, 600u}) {
+        auto values = random_values(n, 31);
+        values[0][0] = std::numeric_limits<int>::min();
+        values[n - 1][n - 1] = 1234567;
+        Matrix m(values);
+        m.swap_rows(0, 1);
+
+        std::ostringstream expected;
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                expected << std::setw(6) << m.get_value(i, j);
+            }
+            expected << "\n";
+        }
+        std::ostringstream actual;
+        write_matrix(actual, m);
+        EXPECT_EQ(actual.str(), expected.str()) << "n = " << n;
+    }
+}
+
+// every value of a narrow matrix at its widest, which is still narrower
+// than the aligned field
+template <typename T>
+void expect_narrow_aligned(std::size_t n) {
+    BasicMatrix<T> m(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            m.set_value(i, j, std::numeric_limits<T>::min());
+        }
+    }
+    std::ostringstream expected;
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            expected << std::setw(6) << static_cast<int>(std::numeric_limits<T>::min());
+        }
+        expected << "\n";
+    }
+    std::ostringstream actual;
+    write_matrix(actual, m);
+    EXPECT_EQ(actual.str(), expected.str()) << "n = " << n;
+}
+
+TEST(MatrixWriter, AlignedNarrowTypesFitTheirBuffers) {
+    for (std::size_t n : {3u, 600u}) {
+        expect_narrow_aligned<std::int8_t>(n);
+        expect_narrow_aligned<std::int16_t>(n);
+    }
+}
+
+TEST(MatrixWriter, CompactModeAndFiles) {
+    Matrix m({{1, -20, 300}, {0, 5, 6}, {7, 8, -9}});
+    std::ostringstream out;
+    {
+        MatrixWriter writer(out, 16);
+        writer.write("M:\n").write(m, MatrixFormat::compact);
+    }
+    EXPECT_EQ(out.str(), "M:\n1 -20 300\n0 5 6\n7 8 -9\n");
+
+    const std::string path = testing::TempDir() + "writer_out.txt";
+    write_matrix_file(path, m);
+    std::ifstream in(path);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(text, "     1   -20   300\n     0     5     6\n     7     8    -9\n");
+    EXPECT_THROW(write_matrix_file(testing::TempDir() + "missing_dir/out.txt", m), std::runtime_error);
+}
+
+TEST(MatrixOutOfCore, TiledResultsMatchInMemory) {
+    auto a_values = random_values(100, 41);
+    auto b_values = random_values(100, 42);
+    const std::string pair = testing::TempDir() + "ooc_pair.bin";
+    save_matrices_binary(pair, Matrix(a_values), Matrix(b_values));
+    const DiskMatrix a(pair, 0), b(pair, 1);
+
+    // a budget this small forces 16 x 16 tiles and single-row add blocks
+    OutOfCoreOptions options;
+    options.memory_budget = 4096;
+
+    DiskMatrix sum = DiskMatrix::create(testing::TempDir() + "ooc_sum.bin", 100);
+    out_of_core_add(a, b, sum, options);
+    DiskMatrix product = DiskMatrix::create(testing::TempDir() + "ooc_product.bin", 100);
+    out_of_core_multiply(a, b, product, options);
+    // and with tiles that cover the whole matrix
+    DiskMatrix whole = DiskMatrix::create(testing::TempDir() + "ooc_whole.bin", 100);
+    out_of_core_multiply(a, b, whole);
+
+    auto sum_values = a_values;
+    for (std::size_t i = 0; i < 100; ++i) {
+        for (std::size_t j = 0; j < 100; ++j) {
+            sum_values[i][j] += b_values[i][j];
+        }
+    }
+    const auto product_values = reference_multiply(a_values, b_values);
+    expect_matrix_eq(load_binary_matrices(testing::TempDir() + "ooc_sum.bin").at(0), sum_values);
+    expect_matrix_eq(load_binary_matrices(testing::TempDir() + "ooc_product.bin").at(0), product_values);
+    expect_matrix_eq(load_binary_matrices(testing::TempDir() + "ooc_whole.bin").at(0), product_values);
+
+    // sums wrap like operator+
+    const int top = std::numeric_limits<int>::max();
+    const std::string extremes = testing::TempDir() + "ooc_extremes.bin";
+    save_matrices_binary(extremes, Matrix({{top, 1}, {-1, top}}), Matrix({{top, top}, {top, 0}}));
+    DiskMatrix extreme_sum = DiskMatrix::create(testing::TempDir() + "ooc_extreme_sum.bin", 2);
+    out_of_core_add(DiskMatrix(extremes, 0), DiskMatrix(extremes, 1), extreme_sum);
+    const Matrix wrapped = Matrix({{top, 1}, {-1, top}}) + Matrix({{top, top}, {top, 0}});
+    expect_matrix_eq(load_binary_matrices(testing::TempDir() + "ooc_extreme_sum.bin").at(0),
+                     {{wrapped.get_value(0, 0), wrapped.get_value(0, 1)}, {wrapped.get_value(1, 0), wrapped.get_value(1, 1)}});
+    EXPECT_EQ(wrapped.get_value(0, 0), -2);
+
+    DiskMatrix small = DiskMatrix::create(testing::TempDir() + "ooc_small.bin", 50);
+    EXPECT_THROW(out_of_core_add(a, small, sum), std::runtime_error);
+    try {
+        out_of_core_multiply(a, b, small);
+        FAIL() << "expected out_of_core_multiply to throw";
+    } catch (const std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), "Result matrix size does not match the product");
+    }
+    // a product written over one of its operands would read back its own output
+    DiskMatrix alias(pair, 1, true);
+    EXPECT_THROW(out_of_core_multiply(a, b, alias), std::invalid_argument);
+    EXPECT_THROW(DiskMatrix(pair, 2), std::runtime_error);
+}
+
+TEST(MatrixBatch, RecordsComeOutInInputOrder) {
+    std::string stream;
+    for (int r = 0; r < 40; r++) {
+        stream += "2\n" + std::to_string(r) + " 0 0 1\n1 0 0 1\n";
+    }
+    const std::string many = write_temp_file("batch_many.txt", stream);
+    EXPECT_EQ(load_matrix_records(many).size(), 40u);
+    const std::string bad = write_temp_file("batch_bad.txt", "1 5 6\n2 1 2 3");
+    try {
+        load_matrix_records(bad);
+        FAIL() << "expected load_matrix_records to throw";
+    } catch (const std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), "Failed to read element for Matrix A at [1][1] in record 1");
+    }
+    const std::string one = write_temp_file("batch_one.txt", "1\n7\n8\n");
+
+    std::ostringstream out, err;
+    const std::size_t failed = run_batch(
+        {many, bad, one},
+        [](const std::string &, std::size_t record, const Matrix &a, const Matrix &b, std::ostream &o, std::ostream &) {
+            o << record << ":" << (a * b).get_value(0, 0) << " ";
+        },
+        out, err);
+    EXPECT_EQ(failed, 1u);
+
+    std::string expected;
+    for (int r = 0; r < 40; r++) {
+        expected += std::to_string(r) + ":" + std::to_string(r) + " ";
+    }
+    expected += "0:56 ";
+    EXPECT_EQ(out.str(), expected);
+    EXPECT_EQ(err.str(), "Error: Failed to read element for Matrix A at [1][1] in record 1\n"
+                         "Error loading matrices from file: " + bad + "\n");
+}
+
+TEST(MatrixBatch, DirectoriesExpandToTheirFilesInOrder) {
+    const std::string dir = testing::TempDir() + "batch_dir";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir + "/nested");
+    for (const auto &[name, value] : {std::pair{"b.txt", 2}, std::pair{"a.txt", 1}, std::pair{"c.txt", 3}}) {
+        std::ofstream(dir + "/" + name) << "1\n" << value << "\n1\n";
+    }
+    // subdirectories are not entered
+    std::ofstream(dir + "/nested/d.txt") << "1\n4\n1\n";
+
+    std::ostringstream out, err;
+    const std::size_t failed = run_batch(
+        {dir, write_temp_file("batch_after.txt", "1\n9\n1\n")},
+        [](const std::string &source, std::size_t, const Matrix &a, const Matrix &, std::ostream &o, std::ostream &) {
+            o << std::filesystem::path(source).filename().string() << "=" << a.get_value(0, 0) << " ";
+        },
+        out, err);
+    EXPECT_EQ(failed, 0u);
+    EXPECT_EQ(out.str(), "a.txt=1 b.txt=2 c.txt=3 batch_after.txt=9 ");
+    EXPECT_EQ(err.str(), "");
+}
+
+TEST(MatrixBatched, InterleavedKernelsMatchOperators) {
+    const GemmIsa saved = gemm_isa();
+    for (GemmIsa isa : {GemmIsa::scalar, GemmIsa::avx2, GemmIsa::avx512}) {
+        if (!gemm_isa_supported(isa)) {
+            continue;
+        }
+        set_gemm_isa(isa);
+        for (std::size_t n : {3u, 7u, 16u}) {
+            // 37 matrices leave the last group partly empty
+            std::vector<Matrix> as, bs;
+            for (unsigned m = 0; m < 37; m++) {
+                as.emplace_back(random_values(n, 100 + m));
+                bs.emplace_back(random_values(n, 200 + m));
+            }
+            const MatrixBatch a(as), b(bs);
+            MatrixBatch sum(0, 0), product(0, 0);
+            batch_add(a, b, sum);
+            batch_multiply(a, b, product);
+            ASSERT_EQ(product.count(), 37u);
+            for (std::size_t m = 0; m < 37; m++) {
+                const Matrix expected_sum = as[m] + bs[m];
+                const Matrix expected_product = as[m] * bs[m];
+                for (std::size_t i = 0; i < n; i++) {
+                    for (std::size_t j = 0; j < n; j++) {
+                        ASSERT_EQ(sum.get_value(m, i, j), expected_sum.get_value(i, j));
+                        ASSERT_EQ(product.get_value(m, i, j), expected_product.get_value(i, j))
+                            << "n = " << n << ", matrix " << m << " at [" << i << "][" << j << "]";
+                    }
+                }
+            }
+
+            // in place, and back out as a Matrix
+            MatrixBatch square = a;
+            batch_multiply(square, square, square);
+            const Matrix last = square.matrix(36);
+            const Matrix expected = as[36] * as[36];
+            EXPECT_EQ(last.get_value(n - 1, 0), expected.get_value(n - 1, 0));
+        }
+    }
+    set_gemm_isa(saved);
+
+    MatrixBatch a(4, 2), b(4, 3), c(0, 0);
+    EXPECT_THROW(batch_add(a, b, c), std::runtime_error);
+    EXPECT_THROW(a.get_value(2, 0, 0), std::out_of_range);
+}
+
+TEST(MatrixFixed, ConstexprOperationsMatchMatrix) {
+    constexpr FixedMatrix<3> a({{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
+    constexpr FixedMatrix<3> b({{9, 8, 7}, {6, 5, 4}, {3, 2, 1}});
+    static_assert(a.sum_diagonal_major() == 15, "major diagonal at compile time");
+    static_assert(a.sum_diagonal_minor() == 15, "minor diagonal at compile time");
+    static_assert((a + b).get_value(1, 1) == 10, "sum at compile time");
+    static_assert((a * b) == FixedMatrix<3>({{30, 24, 18}, {84, 69, 54}, {138, 114, 90}}), "product at compile time");
+
+    // round trip through the dynamic Matrix
+    auto values = random_values(4, 51);
+    auto others = random_values(4, 52);
+    const FixedMatrix<4> x{Matrix(values)}, y{Matrix(others)};
+    expect_matrix_eq((x * y).to_matrix(), reference_multiply(values, others));
+    const Matrix sum = Matrix(values) + Matrix(others);
+    EXPECT_EQ(FixedMatrix<4>(sum), x + y);
+    EXPECT_EQ(x.sum_diagonal_major(), Matrix(values).sum_diagonal_major());
+    EXPECT_EQ(x.sum_diagonal_minor(), Matrix(values).sum_diagonal_minor());
+
+    // extreme values wrap exactly as Matrix does, in constant expressions too
+    constexpr int top = std::numeric_limits<int>::max();
+    constexpr int bottom = std::numeric_limits<int>::min();
+    constexpr FixedMatrix<2> big({{top, bottom}, {top, top}});
+    static_assert(big.sum_diagonal_major() == -2, "wrapped major diagonal at compile time");
+    static_assert((big * big).get_value(1, 1) == 1 + bottom, "wrapped product at compile time");
+    const Matrix dynamic({{top, bottom}, {top, top}});
+    EXPECT_EQ(FixedMatrix<2>(dynamic + dynamic), big + big);
+    EXPECT_EQ(FixedMatrix<2>(dynamic * dynamic), big * big);
+    EXPECT_EQ(big.sum_diagonal_major(), dynamic.sum_diagonal_major());
+    EXPECT_EQ(big.sum_diagonal_minor(), dynamic.sum_diagonal_minor());
+
+    EXPECT_THROW(FixedMatrix<4>(Matrix(3)), std::runtime_error);
+    EXPECT_THROW(x.get_value(4, 0), std::out_of_range);
+}
+
+TEST(MatrixTyped, EveryElementTypeMatchesReference) {
+    expect_typed_product<std::int8_t>(37);
+    expect_typed_product<std::int16_t>(70);
+    expect_typed_product<std::int64_t>(45);
+    expect_typed_product<float>(45);
+    expect_typed_product<double>(45);
+
+    // the int interface is unchanged, and the other types keep its semantics
+    const BasicMatrix<double> d({{1.5, 2}, {3, 4.25}});
+    EXPECT_DOUBLE_EQ(d.sum_diagonal_major(), 5.75);
+    EXPECT_DOUBLE_EQ((d + d).get_value(0, 0), 3.0);
+    BasicMatrix<std::int16_t> w(3);
+    w.set_value(0, 2, 7);
+    w.swap_cols(0, 2);
+    EXPECT_EQ(w.get_value(0, 0), 7);
+    EXPECT_THROW(w.get_value(3, 0), std::out_of_range);
+
+    std::ostringstream out;
+    write_matrix(out, d, MatrixFormat::compact);
+    EXPECT_EQ(out.str(), "1.5 2\n3 4.25\n");
+}
+
+TEST(MatrixAccumulation, PoliciesAgreeWithExactProduct) {
+    // large enough that nearly every sum overflows int
+    const std::size_t n = 41;
+    std::mt19937 gen(71);
+    std::uniform_int_distribution<int> dist(-200000000, 200000000);
+    std::vector<std::vector<int>> a(n, std::vector<int>(n)), b(n, std::vector<int>(n));
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            a[i][j] = dist(gen);
+            b[i][j] = dist(gen);
+        }
+    }
+    const Matrix ma(a), mb(b);
+
+    GemmIsa saved = gemm_isa();
+    for (GemmIsa isa : {GemmIsa::scalar, GemmIsa::avx2, GemmIsa::avx512}) {
+        if (!gemm_isa_supported(isa)) {
+            continue;
+        }
+        set_gemm_isa(isa);
+        const BasicMatrix<std::int64_t> wide = multiply<Accumulation::widen>(ma, mb);
+        const Matrix saturated = multiply<Accumulation::saturate>(ma, mb);
+        bool overflow = false;
+        const Matrix checked = multiply<Accumulation::checked>(ma, mb, &overflow);
+        const Matrix wrapped = ma * mb;
+        EXPECT_TRUE(overflow);
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                std::int64_t exact = 0;
+                for (std::size_t k = 0; k < n; ++k) {
+                    exact += static_cast<std::int64_t>(a[i][k]) * b[k][j];
+                }
+                ASSERT_EQ(wide.get_value(i, j), exact);
+                const std::int64_t clamped = std::min<std::int64_t>(std::max<std::int64_t>(exact, std::numeric_limits<int>::min()),
+                                                                std::numeric_limits<int>::max());
+                ASSERT_EQ(saturated.get_value(i, j), clamped);
+                ASSERT_EQ(checked.get_value(i, j), wrapped.get_value(i, j));
+            }
+        }
+    }
+    set_gemm_isa(saved);
+
+    // small values take the int kernels and report no overflow
+    bool overflow = true;
+    const Matrix small(random_values(20, 72));
+    expect_matrix_eq(multiply<Accumulation::checked>(small, small, &overflow),
+                     reference_multiply(random_values(20, 72), random_values(20, 72)));
+    EXPECT_FALSE(overflow);
+    EXPECT_THROW(multiply<Accumulation::checked>(ma, mb), std::overflow_error);
+}
+
+TEST(MatrixAccumulation, ExtremeOperandsStayExact) {
+    const int lo = std::numeric_limits<int>::min();
+    const int hi = std::numeric_limits<int>::max();
+    // every sum is a multiple of 2^62 past int64's range, and wraps to 0
+    for (std::size_t n : {2u, 4u}) {
+        const Matrix m(std::vector<std::vector<int>>(n, std::vector<int>(n, lo)));
+        bool overflow = false;
+        const Matrix checked = multiply<Accumulation::checked>(m, m, &overflow);
+        EXPECT_TRUE(overflow) << "n = " << n;
+        EXPECT_EQ(checked.get_value(0, 0), 0);
+        EXPECT_EQ(multiply<Accumulation::saturate>(m, m).get_value(n - 1, 0), hi);
+        EXPECT_THROW(multiply<Accumulation::widen>(m, m), std::overflow_error);
+    }
+
+    // the bound overflows int64, the sums do not
+    const Matrix a({{lo, lo, lo}, {hi, hi, hi}, {0, 1, lo}});
+    const Matrix b({{lo, 0, hi}, {lo, 1, lo}, {hi, 2, -1}});
+    const BasicMatrix<std::int64_t> wide = multiply<Accumulation::widen>(a, b);
+
+    // full-range values against an exact reference
+    const std::size_t n = 40;
+    std::mt19937 gen(73);
+    std::uniform_int_distribution<int> dist(lo, hi);
+    std::vector<std::vector<int>> x(n, std::vector<int>(n)), y(n, std::vector<int>(n));
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            x[i][j] = i == j ? lo : dist(gen);
+            y[i][j] = i == j ? hi : dist(gen);
+        }
+    }
+    const Matrix mx(x), my(y);
+    const Matrix saturated = multiply<Accumulation::saturate>(mx, my);
+    bool overflow = false;
+    const Matrix checked = multiply<Accumulation::checked>(mx, my, &overflow);
+    EXPECT_TRUE(overflow);
+    const Matrix wrapped = mx * my;
+    for (std::size_t i = 0; i < 3; ++i) {
+        for (std::size_t j = 0; j < 3; ++j) {
+            __int128 exact = 0;
+            for (std::size_t k = 0; k < 3; ++k) {
+                exact += static_cast<std::int64_t>(a.get_value(i, k)) * b.get_value(k, j);
+            }
+            EXPECT_EQ(wide.get_value(i, j), static_cast<std::int64_t>(exact));
+        }
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            __int128 exact = 0;
+            for (std::size_t k = 0; k < n; ++k) {
+                exact += static_cast<std::int64_t>(x[i][k]) * y[k][j];
+            }
+            const __int128 clamped = std::min<__int128>(std::max<__int128>(exact, lo), hi);
+            ASSERT_EQ(saturated.get_value(i, j), static_cast<int>(clamped));
+            ASSERT_EQ(checked.get_value(i, j), wrapped.get_value(i, j));
+        }
+    }
+}
+
+TEST(MatrixAccumulation, DiagonalSumsWidenSaturateAndCheck) {
+    Matrix m(3);
+    for (std::size_t i = 0; i < 3; ++i) {
+        m.set_value(i, i, std::numeric_limits<int>::max());
+        m.set_value(i, 2 - i, -5);
+    }
+    // (1, 1) is on both diagonals and was overwritten with -5
+    const std::int64_t major = 2LL * std::numeric_limits<int>::max() - 5;
+    EXPECT_EQ(sum_diagonal_major<Accumulation::widen>(m), major);
+    EXPECT_EQ(sum_diagonal_major<Accumulation::saturate>(m), std::numeric_limits<int>::max());
+    EXPECT_EQ(sum_diagonal_major<Accumulation::wrap>(m), m.sum_diagonal_major());
+    bool overflow = false;
+    EXPECT_EQ(sum_diagonal_major<Accumulation::checked>(m, &overflow), m.sum_diagonal_major());
+    EXPECT_TRUE(overflow);
+    EXPECT_EQ(sum_diagonal_minor<Accumulation::checked>(m, &overflow), -15);
+    EXPECT_FALSE(overflow);
+
+    // read through pending column swaps like the members
+    m.swap_cols(0, 2);
+    EXPECT_EQ(sum_diagonal_minor<Accumulation::widen>(m), major);
+}
+
+TEST(MatrixSparse, OperationsMatchDense) {
+    // about 5% nonzeros, some rows empty
+    const std::size_t n = 70;
+    std::mt19937 gen(81);
+    std::uniform_int_distribution<int> value(-9, 9);
+    std::uniform_int_distribution<int> pick(0, 99);
+    auto sparse_values = [&] {
+        std::vector<std::vector<int>> values(n, std::vector<int>(n, 0));
+        for (auto &row : values) {
+            for (auto &v : row) {
+                v = pick(gen) < 5 ? value(gen) : 0;
+            }
+        }
+        return values;
+    };
+    const auto a_values = sparse_values(), b_values = sparse_values();
+    const Matrix a(a_values), b(b_values), dense(random_values(n, 82));
+    auto same = [n](const Matrix &x, const Matrix &y) {
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                if (x.get_value(i, j) != y.get_value(i, j)) {
+                    return false;
+                }
+            }
+        }
+        return x.size() == y.size();
+    };
+
+    for (SparseLayout layout : {SparseLayout::csr, SparseLayout::csc}) {
+        const SparseMatrix sa(a, layout), sb(b, SparseLayout::csr);
+        EXPECT_EQ(sa.layout(), layout);
+        EXPECT_LT(sa.nonzeros(), n * n / 10);
+        EXPECT_TRUE(same(sa.to_dense(), a));
+        EXPECT_EQ(sa.sum_diagonal_major(), a.sum_diagonal_major());
+        EXPECT_EQ(sa.sum_diagonal_minor(), a.sum_diagonal_minor());
+
+        EXPECT_TRUE(same(sa + dense, a + dense));
+        EXPECT_TRUE(same(dense + sa, a + dense));
+        EXPECT_TRUE(same(sa * dense, a * dense));
+        EXPECT_TRUE(same(dense * sa, dense * a));
+        EXPECT_EQ((sa + sb).layout(), layout);
+        EXPECT_TRUE(same((sa + sb).to_dense(), a + b));
+        EXPECT_TRUE(same((sa * sb).to_dense(), a * b));
+
+        // swaps and updates, checked against the same edits on a dense copy
+        SparseMatrix edited = sa;
+        Matrix expected = a;
+        edited.swap_rows(3, 60);
+        expected.swap_rows(3, 60);
+        edited.swap_cols(0, 69);
+        expected.swap_cols(0, 69);
+        edited.set_value(5, 7, 42);
+        expected.set_value(5, 7, 42);
+        edited.set_value(5, 7, 0);
+        expected.set_value(5, 7, 0);
+        edited.set_value(10, 11, -3);
+        expected.set_value(10, 11, -3);
+        EXPECT_TRUE(same(edited.to_dense(), expected));
+        EXPECT_EQ(edited.get_value(10, 11), -3);
+        EXPECT_THROW(edited.get_value(n, 0), std::out_of_range);
+    }
+
+    // sums that cancel are not stored
+    Matrix negated(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            negated.set_value(i, j, -a_values[i][j]);
+        }
+    }
+    EXPECT_EQ((SparseMatrix(a) + SparseMatrix(negated, SparseLayout::csc)).nonzeros(), 0u);
+
+    // sums of shared entries wrap like Matrix's, and a wrap to zero drops out
+    const int top = std::numeric_limits<int>::max();
+    const Matrix high({{top, 0, 0}, {0, std::numeric_limits<int>::min(), 0}, {0, 0, 5}});
+    const Matrix low({{top, 0, 0}, {0, std::numeric_limits<int>::min(), 0}, {0, 0, -5}});
+    const SparseMatrix wrapped = SparseMatrix(high) + SparseMatrix(low);
+    EXPECT_EQ(wrapped.get_value(0, 0), (high + low).get_value(0, 0));
+    EXPECT_EQ(wrapped.get_value(0, 0), -2);
+    EXPECT_EQ(wrapped.nonzeros(), 1u);
+    EXPECT_THROW(SparseMatrix(a) * SparseMatrix(3), std::runtime_error);
+}
+
+TEST(MatrixAdaptive, FormatFollowsDensityAndProductsMatch) {
+    // scattered nonzeros (about 3%), full 16 x 16 tiles on about a tenth of
+    // the tile grid, and dense values, at a size the edge tiles cut short
+    const std::size_t n = 200;
+    constexpr std::size_t kB = BlockSparseMatrix::kBlock;
+    std::mt19937 gen(91);
+    std::uniform_int_distribution<int> value(1, 9);
+    std::uniform_int_distribution<int> pick(0, 99);
+    std::vector<std::vector<int>> scattered(n, std::vector<int>(n, 0)), clustered = scattered;
+    for (auto &row : scattered) {
+        for (auto &v : row) {
+            v = pick(gen) < 3 ? value(gen) : 0;
+        }
+    }
+    for (std::size_t r = 0; r < n; r += kB) {
+        for (std::size_t c = 0; c < n; c += kB) {
+            if (pick(gen) < 10) {
+                for (std::size_t i = r; i < std::min(n, r + kB); ++i) {
+                    for (std::size_t j = c; j < std::min(n, c + kB); ++j) {
+                        clustered[i][j] = value(gen);
+                    }
+                }
+            }
+        }
+    }
+    const Matrix sparse(scattered), blocky(clustered), dense(random_values(n, 92));
+    auto same = [n](const Matrix &x, const Matrix &y) {
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                if (x.get_value(i, j) != y.get_value(i, j)) {
+                    return false;
+                }
+            }
+        }
+        return x.size() == y.size();
+    };
+
+    // the loader's counts are exact, and so is sampling at this size
+    std::string contents = std::to_string(n) + "\n";
+    for (const auto *values : {&clustered, &scattered}) {
+        for (const auto &row : *values) {
+            for (int v : row) {
+                contents += std::to_string(v) + " ";
+            }
+            contents += "\n";
+        }
+    }
+    std::size_t saved = thread_count();
+    set_thread_count(4);
+    Matrix a(0), b(0);
+    DensityStats a_stats, b_stats;
+    load_matrices_parallel(write_temp_file("adaptive.txt", contents), a, b, &a_stats, &b_stats);
+    set_thread_count(saved);
+    for (const auto &[stats, m] : {std::pair{a_stats, blocky}, std::pair{b_stats, sparse}}) {
+        const DensityStats exact = SparseMatrix(m).density();
+        EXPECT_EQ(stats.n, n);
+        EXPECT_EQ(stats.nonzeros, exact.nonzeros);
+        EXPECT_EQ(stats.blocks, exact.blocks);
+        EXPECT_EQ(sample_density(m).nonzeros, exact.nonzeros);
+        EXPECT_EQ(sample_density(m).blocks, exact.blocks);
+    }
+
+    const AdaptiveMatrix operands[] = {AdaptiveMatrix(dense), AdaptiveMatrix(b, b_stats), AdaptiveMatrix(a, a_stats)};
+    EXPECT_EQ(operands[0].format(), StorageFormat::dense);
+    EXPECT_EQ(operands[1].format(), StorageFormat::csr);
+    EXPECT_EQ(operands[2].format(), StorageFormat::blocked);
+    EXPECT_EQ(AdaptiveMatrix(Matrix(random_values(40, 93))).format(), StorageFormat::dense);
+    // the bound behind the overflow check reads every format's values
+    EXPECT_TRUE(product_fits_int(operands[1], operands[2]));
+    Matrix big = b;
+    big.set_value(3, 5, std::numeric_limits<int>::min());
+    const AdaptiveMatrix big_sparse{SparseMatrix(big)};
+    EXPECT_EQ(big_sparse.format(), StorageFormat::csr);
+    EXPECT_EQ(big_sparse.max_magnitude(), std::uint64_t(1) << 31);
+    EXPECT_FALSE(product_fits_int(big_sparse, operands[2]));
+    // counts for another matrix are rejected rather than trusted
+    EXPECT_THROW(AdaptiveMatrix(Matrix(random_values(40, 93)), a_stats), std::runtime_error);
+
+    const BlockSparseMatrix &tiles = operands[2].blocked();
+    EXPECT_TRUE(same(tiles.to_dense(), blocky));
+    EXPECT_TRUE(same(tiles.to_sparse(SparseLayout::csc).to_dense(), blocky));
+    EXPECT_EQ(tiles.get_value(n - 1, n - 1), clustered[n - 1][n - 1]);
+    EXPECT_THROW(tiles.get_value(n, 0), std::out_of_range);
+
+    // every pairing of kernels gives the dense product
+    for (const AdaptiveMatrix &x : operands) {
+        for (const AdaptiveMatrix &y : operands) {
+            EXPECT_TRUE(same((x * y).to_dense(), x.to_dense() * y.to_dense()))
+                << static_cast<int>(x.format()) << " * " << static_cast<int>(y.format());
+            EXPECT_EQ((x * y).get_value(7, 3), (x.to_dense() * y.to_dense()).get_value(7, 3));
+        }
+    }
+    EXPECT_THROW(operands[1] * AdaptiveMatrix(Matrix(3)), std::runtime_error);
+}
+
+TEST(MatrixStructured, SpecializedOperationsMatchDense) {
+    const std::size_t n = 45;
+    const auto values = random_values(n, 95);
+    const Matrix dense(random_values(n, 96));
+    auto same = [n](const Matrix &x, const Matrix &y) {
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                if (x.get_value(i, j) != y.get_value(i, j)) {
+                    return false;
+                }
+            }
+        }
+        return x.size() == y.size();
+    };
+    // values outside the band of (i, j) zeroed
+    auto banded = [&](std::size_t lower, std::size_t upper) {
+        Matrix m(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = i > lower ? i - lower : 0; j < n && j <= i + upper; ++j) {
+                m.set_value(i, j, values[i][j]);
+            }
+        }
+        return m;
+    };
+
+    // diagonal, triangular both ways, and a 2 / 3 band
+    const std::pair<std::size_t, std::size_t> shapes[] = {{0, 0}, {0, n}, {n, 0}, {2, 3}};
+    for (const auto &[lower, upper] : shapes) {
+        const Matrix m = banded(lower, upper);
+        const BandMatrix band(m, lower, upper);
+        EXPECT_TRUE(same(band.to_dense(), m));
+        EXPECT_EQ(band.sum_diagonal_major(), m.sum_diagonal_major());
+        EXPECT_EQ(band.sum_diagonal_minor(), m.sum_diagonal_minor());
+        EXPECT_TRUE(same(band + dense, m + dense));
+        EXPECT_TRUE(same(dense + band, m + dense));
+        EXPECT_TRUE(same(band * dense, m * dense));
+        EXPECT_TRUE(same(dense * band, dense * m));
+        for (const auto &[lower2, upper2] : shapes) {
+            const Matrix m2 = banded(lower2, upper2);
+            const BandMatrix band2(m2, lower2, upper2);
+            EXPECT_TRUE(same((band + band2).to_dense(), m + m2));
+            EXPECT_TRUE(same((band * band2).to_dense(), m * m2));
+        }
+    }
+    EXPECT_EQ(BandMatrix::diagonal(n).stored(), n);
+    EXPECT_EQ(BandMatrix::upper_triangular(n).stored(), n * (n + 1) / 2);
+    EXPECT_EQ((BandMatrix::upper_triangular(n) * BandMatrix::upper_triangular(n)).lower(), 0u);
+    EXPECT_THROW(BandMatrix(dense, 1, 1), std::invalid_argument);
+    BandMatrix diagonal = BandMatrix::diagonal(n);
+    EXPECT_EQ(diagonal.get_value(3, 4), 0);
+    EXPECT_THROW(diagonal.set_value(3, 4, 1), std::invalid_argument);
+
+    // symmetric: m + m^T
+    Matrix sym(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < n; ++j) {
+            sym.set_value(i, j, values[i][j] + values[j][i]);
+        }
+    }
+    const SymmetricMatrix s(sym);
+    EXPECT_EQ(s.lower().stored(), n * (n + 1) / 2);
+    EXPECT_TRUE(same(s.to_dense(), sym));
+    EXPECT_EQ(s.get_value(3, 40), sym.get_value(3, 40));
+    EXPECT_EQ(s.sum_diagonal_major(), sym.sum_diagonal_major());
+    EXPECT_EQ(s.sum_diagonal_minor(), sym.sum_diagonal_minor());
+    EXPECT_TRUE(same((s + s).to_dense(), sym + sym));
+    EXPECT_TRUE(same(s + dense, sym + dense));
+    EXPECT_TRUE(same(s * dense, sym * dense));
+    EXPECT_TRUE(same(dense * s, dense * sym));
+    EXPECT_TRUE(same(s * s, sym * sym));
+    EXPECT_THROW(SymmetricMatrix{dense}, std::invalid_argument);
+
+    // permutations: the row reversal that turns A into B in input.txt, and
+    // a shuffle
+    std::vector<std::size_t> reversed(n), shuffled(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        reversed[i] = n - 1 - i;
+        shuffled[i] = i;
+    }
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(97));
+    const PermutationMatrix j(reversed), p(shuffled);
+    EXPECT_TRUE(same(j * dense, j.to_dense() * dense));
+    EXPECT_TRUE(same(dense * p, dense * p.to_dense()));
+    EXPECT_TRUE(same(p * dense, p.to_dense() * dense));
+    EXPECT_TRUE(same((j * p).to_dense(), j.to_dense() * p.to_dense()));
+    EXPECT_TRUE(same((p * p.inverse()).to_dense(), PermutationMatrix(n).to_dense()));
+    EXPECT_TRUE(same(p + dense, p.to_dense() + dense));
+    // through pending column swaps, and wrapping at INT_MAX like Matrix
+    Matrix swapped = dense;
+    swapped.swap_cols(0, n - 1);
+    swapped.set_value(0, shuffled[0], std::numeric_limits<int>::max());
+    EXPECT_TRUE(same(swapped + p, swapped + p.to_dense()));
+    EXPECT_EQ((p + swapped).get_value(0, shuffled[0]), std::numeric_limits<int>::min());
+    EXPECT_EQ(PermutationMatrix(p.to_dense()).perm(), shuffled);
+    EXPECT_EQ(j.sum_diagonal_minor(), static_cast<int>(n));
+    EXPECT_EQ(p.sum_diagonal_major(), p.to_dense().sum_diagonal_major());
+    EXPECT_THROW(PermutationMatrix(std::vector<std::size_t>{0, 0}), std::invalid_argument);
+    EXPECT_THROW(PermutationMatrix{dense}, std::invalid_argument);
+}
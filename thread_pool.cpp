@@ -0,0 +1,192 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// index of the pool queue owned by this thread, or npos outside a worker
+constexpr std::size_t npos = static_cast<std::size_t>(-1);
+thread_local const void *t_pool = nullptr;
+thread_local std::size_t t_queue = npos;
+
+std::size_t default_thread_count() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::unique_ptr<ThreadPool> &pool_slot() {
+    static std::unique_ptr<ThreadPool> pool = std::make_unique<ThreadPool>(default_thread_count());
+    return pool;
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(std::size_t threads) {
+    const std::size_t workers = threads > 1 ? threads - 1 : 0;
+    queues_.reserve(workers);
+    for (std::size_t i = 0; i < workers; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    workers_.reserve(workers);
+    for (std::size_t i = 0; i < workers; ++i) {
+        workers_.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (queues_.empty()) {
+        task();
+        return;
+    }
+
+    // workers push onto their own deque; other threads spread tasks round robin
+    const std::size_t index = t_pool == this ? t_queue : next_queue_++ % queues_.size();
+    {
+        // count the task before it becomes visible so pending_ never underflows
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++pending_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    sleep_cv_.notify_one();
+}
+
+bool ThreadPool::pop_or_steal(std::function<void()> &task) {
+    const std::size_t count = queues_.size();
+    const std::size_t own = t_pool == this ? t_queue : npos;
+
+    if (own != npos) {
+        WorkerQueue &queue = *queues_[own];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+
+    const std::size_t start = own != npos ? own + 1 : next_queue_.load();
+    for (std::size_t offset = 0; offset < count; ++offset) {
+        WorkerQueue &victim = *queues_[(start + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::run_one() {
+    std::function<void()> task;
+    if (!pop_or_steal(task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop(std::size_t index) {
+    t_pool = this;
+    t_queue = index;
+    for (;;) {
+        if (run_one()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+        if (stopping_ && pending_ == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallel_for(std::size_t count, const std::function<void(std::size_t)> &fn, std::size_t grain) {
+    if (grain == 0) {
+        grain = std::max<std::size_t>(1, count / (size() * 4));
+    }
+    if (count <= grain || queues_.empty()) {
+        for (std::size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    TaskGroup group(*this);
+    for (std::size_t begin = 0; begin < count; begin += grain) {
+        const std::size_t end = std::min(count, begin + grain);
+        group.run([&fn, begin, end] {
+            for (std::size_t i = begin; i < end; ++i) {
+                fn(i);
+            }
+        });
+    }
+    group.wait();
+}
+
+TaskGroup::~TaskGroup() {
+    // never leave tasks running that reference a destroyed group
+    while (pending_ > 0) {
+        if (!pool_.run_one()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void TaskGroup::run(std::function<void()> fn) {
+    ++pending_;
+    pool_.submit([this, fn = std::move(fn)] {
+        try {
+            fn();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        --pending_;
+    });
+}
+
+void TaskGroup::wait() {
+    while (pending_ > 0) {
+        if (!pool_.run_one()) {
+            std::this_thread::yield();
+        }
+    }
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+ThreadPool &default_thread_pool() {
+    return *pool_slot();
+}
+
+void set_thread_count(std::size_t threads) {
+    auto &pool = pool_slot();
+    pool.reset();
+    pool = std::make_unique<ThreadPool>(threads == 0 ? default_thread_count() : threads);
+}
+
+std::size_t thread_count() {
+    return default_thread_pool().size();
+}
@@ -0,0 +1,89 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work-stealing pool of persistent worker threads. every worker owns a
+// deque: it pushes and pops its own tasks at the back and, when it runs
+// dry, steals the oldest task from the front of another worker's deque.
+// idle cores therefore pick up whatever tiles are left instead of waiting
+// on a fixed share of the work.
+class ThreadPool {
+public:
+    // a pool of `threads` threads in total: threads that wait on a TaskGroup
+    // help run tasks, so threads - 1 workers are started
+    explicit ThreadPool(std::size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    std::size_t size() const { return workers_.size() + 1; }
+
+    // calls fn(i) for every i in [0, count). the range is cut into tasks of
+    // `grain` indices (0 picks a few tasks per thread) and returns once all
+    // are done, rethrowing the first exception thrown by fn.
+    void parallel_for(std::size_t count, const std::function<void(std::size_t)> &fn, std::size_t grain = 0);
+
+private:
+    friend class TaskGroup;
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void submit(std::function<void()> task);
+    // run one queued task on the calling thread, returning false if there was none
+    bool run_one();
+    bool pop_or_steal(std::function<void()> &task);
+    void worker_loop(std::size_t index);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<std::size_t> pending_{0};
+    std::atomic<std::size_t> next_queue_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    bool stopping_ = false;
+};
+
+// set of tasks submitted to a pool that can be waited on together. wait()
+// runs queued tasks on the calling thread until the group is done, so
+// groups can be nested inside tasks without deadlocking the pool.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool &pool) : pool_(pool) {}
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    void run(std::function<void()> fn);
+    // blocks until every task has finished and rethrows the first exception
+    void wait();
+
+private:
+    ThreadPool &pool_;
+    std::atomic<std::size_t> pending_{0};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
+
+// process-wide pool used by the Matrix operations. it starts with
+// std::thread::hardware_concurrency() threads; set_thread_count() replaces it
+// (0 restores the default) and must not race with running operations.
+ThreadPool &default_thread_pool();
+void set_thread_count(std::size_t threads);
+std::size_t thread_count();
+
+#endif // __THREAD_POOL_HPP__
@@ -0,0 +1,45 @@
+#ifndef __WRAPPING_HPP__
+#define __WRAPPING_HPP__
+
+#include <type_traits>
+
+// integer matrix arithmetic wraps like the element type. signed overflow is
+// undefined in C++, so the integer kernels add and multiply in the unsigned
+// type of the same width (never narrower than unsigned int, which keeps
+// int8 and int16 from being promoted back to a signed int) and convert the
+// result back, which GCC and Clang define as modulo 2^bits. floating-point
+// types pass through.
+// GCC vector lanes are not promoted, so those just use wrapping_lane_t, the
+// unsigned type of T's own width.
+template <typename T, bool = std::is_integral_v<T>>
+struct wrapping_lane {
+    using type = T;
+};
+template <typename T>
+struct wrapping_lane<T, true> {
+    using type = std::make_unsigned_t<T>;
+};
+template <typename T>
+using wrapping_lane_t = typename wrapping_lane<T>::type;
+template <typename T>
+using wrapping_t = std::conditional_t<(std::is_integral_v<T> && sizeof(T) < sizeof(unsigned)), unsigned,
+                                      wrapping_lane_t<T>>;
+
+template <typename T>
+constexpr T wrapping_add(T x, T y) {
+    return static_cast<T>(static_cast<wrapping_t<T>>(x) + static_cast<wrapping_t<T>>(y));
+}
+
+template <typename T>
+constexpr T wrapping_sub(T x, T y) {
+    return static_cast<T>(static_cast<wrapping_t<T>>(x) - static_cast<wrapping_t<T>>(y));
+}
+
+// acc + x * y
+template <typename T>
+constexpr T wrapping_madd(T acc, T x, T y) {
+    using U = wrapping_t<T>;
+    return static_cast<T>(static_cast<U>(acc) + static_cast<U>(x) * static_cast<U>(y));
+}
+
+#endif // __WRAPPING_HPP__